@@ -116,6 +116,19 @@
 #define ID_DAP_Vendor30 0x9EU
 #define ID_DAP_Vendor31 0x9FU
 
+// Vendor commands implemented in DAP_vendor.c
+#define ID_DAP_VendorReadMemory ID_DAP_Vendor16
+#define ID_DAP_VendorWriteMemory ID_DAP_Vendor17
+#define ID_DAP_VendorPollMemory ID_DAP_Vendor25
+// Flash programming commands implemented in vendor_flash.c
+#define ID_DAP_VendorFlashLoad ID_DAP_Vendor18
+#define ID_DAP_VendorFlashInit ID_DAP_Vendor19
+#define ID_DAP_VendorFlashErase ID_DAP_Vendor20
+#define ID_DAP_VendorFlashProgram ID_DAP_Vendor21
+#define ID_DAP_VendorFlashVerify ID_DAP_Vendor22
+#define ID_DAP_VendorFlashStatus ID_DAP_Vendor23
+#define ID_DAP_VendorFlashUninit ID_DAP_Vendor24
+
 // DAP Extended range of Vendor Command IDs
 
 #define ID_DAP_VendorExFirst 0xA0U
@@ -139,6 +152,7 @@
 #define DAP_ID_PRODUCT_FW_VER 9U
 #define DAP_ID_CAPABILITIES 0xF0U
 #define DAP_ID_TIMESTAMP_CLOCK 0xF1U
+#define DAP_ID_SWJ_CLOCK 0xF8U // Vendor: achieved SWJ clock in Hertz
 #define DAP_ID_UART_RX_BUFFER_SIZE 0xFBU
 #define DAP_ID_UART_TX_BUFFER_SIZE 0xFCU
 #define DAP_ID_SWO_BUFFER_SIZE 0xFDU
@@ -245,6 +259,7 @@
 #if 0
 #include "cmsis_compiler.h"
 #endif
+#include "esp_cpu.h"
 
 // DAP Data structure
 typedef struct
@@ -301,6 +316,10 @@ extern "C"
   extern void JTAG_WriteAbort(uint32_t data);
   extern uint8_t JTAG_Transfer(uint32_t request, uint32_t *data);
   extern uint8_t SWD_Transfer(uint32_t request, uint32_t *data);
+  extern uint8_t SWD_TransferBlock(uint32_t request, uint32_t *data, uint32_t count, uint32_t retry);
+  extern uint8_t SWD_TransferBlockRead(uint32_t request, uint8_t *data, uint32_t count, uint32_t *done);
+  extern uint8_t SWD_TransferBlockWrite(uint32_t request, const uint8_t *data, uint32_t count, uint32_t *done);
+  extern void SWD_CalibrateClock(uint32_t *fast_period, uint32_t *slow_period);
 
   extern void Delayms(uint32_t delay);
 
@@ -341,10 +360,12 @@ extern "C"
   extern uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response);
 
   extern void DAP_Setup(void);
+  extern void Set_DAP_Clock_Delay(uint32_t clock);
+  extern uint32_t DAP_GetClock(void);
 
 // Configurable delay for clock generation
 #ifndef DELAY_SLOW_CYCLES
-#define DELAY_SLOW_CYCLES 3U // Number of cycles for one iteration
+#define DELAY_SLOW_CYCLES 1U // Delay is counted in CPU cycles (CCOUNT)
 #endif
   // #if defined(__CC_ARM)
   // __STATIC_FORCEINLINE void PIN_DELAY_SLOW (uint32_t delay) {
@@ -363,11 +384,13 @@ extern "C"
   // }
   // #endif
 
+  // Busy wait on the cycle counter so the delay does not depend on
+  // the compiler or on flash cache misses
   static inline void PIN_DELAY_SLOW(uint32_t delay)
   {
-    for(int i = 0; i < delay; i++)
+    uint32_t start = esp_cpu_get_cycle_count();
+    while ((uint32_t)(esp_cpu_get_cycle_count() - start) < delay)
     {
-      __asm__ volatile("nop");
     }
   }
 
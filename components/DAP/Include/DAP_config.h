@@ -41,6 +41,7 @@
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "spi_swd.h"
 
 #if defined(__GNUC__) && !defined(__STATIC_FORCEINLINE)
 #define __STATIC_FORCEINLINE static inline __attribute__((always_inline))
@@ -94,13 +95,16 @@
 /// 命令和响应数据的最大数据包大小。
 /// 此配置设置用于优化与调试器的通信性能,取决于 USB 外设。
 /// 典型值为:全速 USB HID 或 WinUSB 为 64,高速 USB HID 为 1024,高速 USB WinUSB 为 512。
-#define DAP_PACKET_SIZE         64              ///< 指定数据包大小(字节)
+/// 与 USBIP 传输的包大小相同(main/daplink/dap_configuration.h, WinUSB 为 512),
+/// DAP_Info 报告的大小、厂商命令的缓冲区和单包数据长度都以此为准。
+#define DAP_PACKET_SIZE         512U            ///< 指定数据包大小(字节)
 
 /// 命令和响应数据的最大数据包缓冲区数。
 /// 此配置设置用于优化与调试器的通信性能,取决于 USB 外设。
 /// 对于 RAM 或 USB 缓冲区有限的设备,可以减小设置(有效范围为 1 .. 255)。
 /// 对于高速 USB,将设置更改为 4。
-#define DAP_PACKET_COUNT        1              ///< 缓冲区: 64 = 全速, 4 = 高速
+/// 网络版本的请求在 DAP_handle.c 中排队, 不能超过其环形缓冲区的包数(DAP_BUFFER_NUM, 至少为10)。
+#define DAP_PACKET_COUNT        8              ///< 缓冲区: 64 = 全速, 4 = 高速
 
 /// 指示是否支持 UART 串行线输出(SWO)跟踪。
 /// 此信息作为<b>功能</b>的一部分由命令 \ref DAP_Info 返回。
@@ -192,6 +196,10 @@ DAP 硬件 I/O 引脚访问函数
 #define PIN_LED_CONNECTED GPIO_NUM_17
 #define PIN_LED_RUNNING GPIO_NUM_18
 
+/// SWD 是否由 SPI 外设移位(3 线半双工),时钟过低或 SPI 不可用时回退到 GPIO 模拟。
+/// 在目标板上用 PROGRAMMER_SWD_BENCHMARK 测过速率之前默认关闭。
+#define DAP_SPI_SWD             0               ///< SPI SWD: 1 = 启用, 0 = 仅 GPIO 模拟
+
 /** 设置 JTAG I/O 引脚: TCK, TMS, TDI, TDO, nTRST 和 nRESET。
 配置 JTAG 模式的 DAP 硬件 I/O 引脚:
  - TCK, TMS, TDI, nTRST, nRESET 设为输出模式并设为高电平。
@@ -201,12 +209,8 @@ __STATIC_INLINE void PORT_JTAG_SETUP(void)
 {
 }
 
-/** 设置 SWD I/O 引脚: SWCLK, SWDIO 和 nRESET。
-配置串行线调试(SWD)模式的 DAP 硬件 I/O 引脚:
- - SWCLK, SWDIO, nRESET 设为输出模式并设为默认高电平。
- - TDI, TMS, nTRST 设为高阻态模式(SWD 模式下不使用这些引脚)。
-*/
-__STATIC_INLINE void PORT_SWD_SETUP(void)
+/// SWCLK/SWDIO 由 GPIO 直接驱动(GPIO 模拟 SWD 及 DAP_SWJ_Pins 使用)
+__STATIC_INLINE void PORT_SWD_GPIO_SETUP(void)
 {
     gpio_pad_select_gpio(PIN_SWCLK);
 	gpio_set_direction(PIN_SWCLK, GPIO_MODE_INPUT_OUTPUT);
@@ -217,12 +221,32 @@ __STATIC_INLINE void PORT_SWD_SETUP(void)
 	gpio_set_level(PIN_SWDIO, 1);
 }
 
+/** 设置 SWD I/O 引脚: SWCLK, SWDIO 和 nRESET。
+配置串行线调试(SWD)模式的 DAP 硬件 I/O 引脚:
+ - SWCLK, SWDIO, nRESET 设为输出模式并设为默认高电平。
+ - TDI, TMS, nTRST 设为高阻态模式(SWD 模式下不使用这些引脚)。
+*/
+__STATIC_INLINE void PORT_SWD_SETUP(void)
+{
+#if (DAP_SPI_SWD != 0)
+	// 优先由 SPI 外设接管 SWCLK/SWDIO
+	if (spi_swd_init())
+	{
+		return;
+	}
+#endif
+	PORT_SWD_GPIO_SETUP();
+}
+
 /** 禁用 JTAG/SWD I/O 引脚。
 禁用 DAP 硬件 I/O 引脚,配置:
  - TCK/SWCLK, TMS/SWDIO, TDI, TDO, nTRST, nRESET 设为高阻态模式。
 */
 __STATIC_INLINE void PORT_OFF(void)
 {
+#if (DAP_SPI_SWD != 0)
+	spi_swd_deinit();
+#endif
 	gpio_pad_select_gpio(PIN_SWCLK);
 	gpio_set_direction(PIN_SWCLK, GPIO_MODE_INPUT);
 	gpio_set_level(PIN_SWCLK, 0);
@@ -266,7 +290,7 @@ __STATIC_FORCEINLINE void     PIN_SWCLK_TCK_CLR(void)
 */
 __STATIC_FORCEINLINE uint32_t PIN_SWDIO_TMS_IN(void)
 {
-    return gpio_get_level(PIN_SWDIO);
+    return (READ_PERI_REG(GPIO_IN_REG) >> PIN_SWDIO) & 1U;
 }
 
 /** SWDIO/TMS I/O 引脚: 设置输出为高电平。
@@ -290,7 +314,7 @@ __STATIC_FORCEINLINE void     PIN_SWDIO_TMS_CLR(void)
 */
 __STATIC_FORCEINLINE uint32_t PIN_SWDIO_IN(void)
 {
-    return (uint32_t)gpio_get_level(PIN_SWDIO);
+    return (READ_PERI_REG(GPIO_IN_REG) >> PIN_SWDIO) & 1U;
 }
 
 /** SWDIO I/O 引脚: 设置输出(仅在 SWD 模式下使用)。
@@ -310,10 +334,11 @@ __STATIC_FORCEINLINE void     PIN_SWDIO_OUT(uint32_t bit)
 
 /** SWDIO I/O 引脚: 切换到输出模式(仅在 SWD 模式下使用)。
 将 SWDIO DAP 硬件 I/O 引脚配置为输出模式。在调用 \ref PIN_SWDIO_OUT 函数之前调用此函数。
+每次传输都要切换两次方向, 直接写输出使能寄存器; 输入在 PORT_SWD_SETUP 中已一直使能。
 */
 __STATIC_FORCEINLINE void     PIN_SWDIO_OUT_ENABLE(void)
 {
-    gpio_set_direction(PIN_SWDIO, GPIO_MODE_OUTPUT);
+    WRITE_PERI_REG(GPIO_ENABLE_W1TS_REG, (0x1 << PIN_SWDIO));
 }
 
 /** SWDIO I/O 引脚: 切换到输入模式(仅在 SWD 模式下使用)。
@@ -321,7 +346,7 @@ __STATIC_FORCEINLINE void     PIN_SWDIO_OUT_ENABLE(void)
 */
 __STATIC_FORCEINLINE void     PIN_SWDIO_OUT_DISABLE(void)
 {
-	gpio_set_direction(PIN_SWDIO, GPIO_MODE_INPUT);
+    WRITE_PERI_REG(GPIO_ENABLE_W1TC_REG, (0x1 << PIN_SWDIO));
 }
 
 
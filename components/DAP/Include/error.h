@@ -82,6 +82,13 @@ typedef enum
     ERROR_IAP_NO_INTERCEPT,
     ERROR_BL_UPDT_BAD_CRC,
 
+    /* Offline programmer */
+    ERROR_ALGO_FILE,
+    ERROR_ALGO_RAM,
+    ERROR_IMAGE_FILE,
+    ERROR_IMAGE_BOUNDS,
+    ERROR_TARGET_BUSY,
+
     // Add new values here
 
     ERROR_COUNT
@@ -0,0 +1,132 @@
+/**
+ * @file    flash_algo.h
+ * @brief   Flash algorithm loaded from a file at runtime
+ *
+ * A flash algorithm file is turned into a program_target_t laid out in
+ * target RAM as follows:
+ *
+ *   ram_start                 breakpoint stub (FLASH_ALGO_HEADER_SIZE)
+ *   + FLASH_ALGO_HEADER_SIZE  algorithm code and data
+ *                             helper routines (CRC32, blank check), left out if RAM is short
+ *   program_buffer            one or two page buffers used by ProgramPage/Verify
+ *   ram_start + ram_size      stack top (FLASH_ALGO_STACK_SIZE reserved)
+ */
+#ifndef FLASH_ALGO_H
+#define FLASH_ALGO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "flash_blob.h"
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLASH_ALGO_MAX_SECTORS  16          // Max entries of the sector table
+#define FLASH_ALGO_HEADER_SIZE  0x20        // Breakpoint stub in front of the algorithm
+#define FLASH_ALGO_STACK_SIZE   0x400       // Stack reserved at the top of target RAM
+#define FLASH_ALGO_ENTRY_NONE   0xFFFFFFFF  // Entry offset of a missing function
+
+// Algorithm file layout, all fields little endian:
+//   flash_algo_file_header_t header
+//   sector_info_t            sectors[header.sector_count]
+//   uint8_t                  blob[header.blob_size]
+// Entry points and static base are offsets into blob.
+#define FLASH_ALGO_FILE_MAGIC   0x4F474C41  // "ALGO"
+
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint32_t init;
+    uint32_t uninit;
+    uint32_t erase_chip;
+    uint32_t erase_sector;
+    uint32_t program_page;
+    uint32_t verify;
+    uint32_t static_base;
+    uint32_t flash_start;
+    uint32_t flash_size;
+    uint32_t page_size;
+    uint32_t erased_value;
+    uint32_t sector_count;
+    uint32_t blob_size;
+} flash_algo_file_header_t;
+
+// Offsets of the algorithm functions inside the blob
+typedef struct
+{
+    uint32_t init;
+    uint32_t uninit;
+    uint32_t erase_chip;
+    uint32_t erase_sector;
+    uint32_t program_page;
+    uint32_t verify;
+    uint32_t static_base;
+} flash_algo_entries_t;
+
+typedef struct
+{
+    program_target_t target;                        // Entries and RAM layout for swd_flash_syscall_exec
+    sector_info_t sectors[FLASH_ALGO_MAX_SECTORS];  // Ascending (start, sector size) pairs
+    uint32_t sector_count;
+    uint32_t flash_start;
+    uint32_t flash_size;
+    uint32_t page_size;
+    uint8_t erased_value;
+    uint8_t program_buffer_count;                   // 2 if RAM allows double buffered programming
+    uint32_t crc32;                                 // Entry of the on-target CRC32 routine, 0 if not loaded
+    uint32_t blank_check;                           // Entry of the on-target blank check routine, 0 if not loaded
+} flash_algo_t;
+
+/**
+ * @brief Load a flash algorithm file and place it in target RAM
+ *
+ * Accepts a Keil .FLM file or the prebuilt format described above.
+ *
+ * @param path      algorithm file
+ * @param ram_start target RAM base the algorithm runs from
+ * @param ram_size  target RAM size available to the algorithm
+ * @param algo      filled on success, release with flash_algo_free()
+ * @return ERROR_SUCCESS, ERROR_ALGO_FILE or ERROR_ALGO_RAM
+ */
+dap_err_t flash_algo_load(const char *path, uint32_t ram_start, uint32_t ram_size, flash_algo_t *algo);
+
+/**
+ * @brief Same as flash_algo_load() for an already opened stream
+ *
+ * Used for algorithms that arrive over the debug link, the stream must support fseek().
+ */
+dap_err_t flash_algo_load_stream(FILE *fp, uint32_t ram_start, uint32_t ram_size, flash_algo_t *algo);
+
+/**
+ * @brief Allocate a zeroed blob buffer with the breakpoint stub in front
+ *
+ * The algorithm itself is copied to the returned buffer at offset FLASH_ALGO_HEADER_SIZE,
+ * room for the helper routines is reserved after it.
+ */
+uint32_t *flash_algo_alloc_blob(uint32_t blob_size);
+
+/**
+ * @brief Lay out an algorithm blob in target RAM and fill algo->target
+ *
+ * Takes ownership of blob (from flash_algo_alloc_blob) on success.
+ * algo->page_size must be set beforehand.
+ */
+dap_err_t flash_algo_place(flash_algo_t *algo, uint32_t *blob, uint32_t blob_size,
+                           const flash_algo_entries_t *entries, uint32_t ram_start, uint32_t ram_size);
+
+void flash_algo_free(flash_algo_t *algo);
+
+/**
+ * @brief Find the sector containing addr
+ *
+ * @return sector start address, *size is set to 0 if addr is outside the flash
+ */
+uint32_t flash_algo_sector(const flash_algo_t *algo, uint32_t addr, uint32_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
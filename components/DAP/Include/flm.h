@@ -0,0 +1,36 @@
+/**
+ * @file    flm.h
+ * @brief   Keil MDK .FLM flash algorithm loader
+ *
+ * A .FLM file is an ELF32 image built by the CMSIS flash algorithm template.
+ * PrgCode/PrgData hold the position independent algorithm, DevDscr holds
+ * the FlashDevice descriptor and the entry points are found in the symbol
+ * table. The file is parsed in place, only the algorithm itself is read
+ * into memory.
+ */
+#ifndef FLM_H
+#define FLM_H
+
+#include <stdio.h>
+#include "flash_algo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Load a .FLM flash algorithm and place it in target RAM
+ *
+ * @param fp        open file, positioned anywhere
+ * @param ram_start target RAM base the algorithm runs from
+ * @param ram_size  target RAM size available to the algorithm
+ * @param algo      filled on success, release with flash_algo_free()
+ * @return ERROR_SUCCESS, ERROR_ALGO_FILE, ERROR_ALGO_RAM or ERROR_INTERNAL
+ */
+dap_err_t flm_load(FILE *fp, uint32_t ram_start, uint32_t ram_size, flash_algo_t *algo);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
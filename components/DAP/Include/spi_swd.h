@@ -0,0 +1,41 @@
+/**
+ * @file    spi_swd.h
+ * @brief   SWD transport shifted by the SPI peripheral
+ *
+ * SWCLK and SWDIO are routed to an SPI host in 3-wire half duplex mode,
+ * LSB first. Every SWD packet is cut into phases at the points where the
+ * line turns around, the bit-banged path in SW_DP.c stays available when
+ * the SPI engine is not attached.
+ */
+#ifndef SPI_SWD_H
+#define SPI_SWD_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Attach SWCLK/SWDIO to the SPI host, returns 0 on failure
+uint8_t spi_swd_init(void);
+// Release the SPI host, the pins go back to GPIO
+void spi_swd_deinit(void);
+// Non zero while SWD goes through the SPI host
+uint8_t spi_swd_active(void);
+// Requested SWCLK frequency, applied now or at the next spi_swd_init()
+void spi_swd_set_clock(uint32_t clock);
+// SWCLK frequency the SPI host actually runs at, in Hertz
+uint32_t spi_swd_get_clock(void);
+
+// Drive count bits of data on SWDIO, LSB first
+void spi_swd_sequence_write(uint32_t count, const uint8_t *data);
+// Capture count bits from SWDIO, LSB first
+void spi_swd_sequence_read(uint32_t count, uint8_t *data);
+// Same contract as SWD_Transfer()
+uint8_t spi_swd_transfer(uint32_t request, uint32_t *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -39,17 +39,37 @@ typedef enum
 uint8_t swd_init(void);
 uint8_t swd_off(void);
 uint8_t swd_init_debug(void);
+// Halve the clock from max_clock until SWD accesses are reliable, returns the clock or 0
+uint32_t swd_probe_clock(uint32_t max_clock);
+// SWCLK for swd_init_debug(), with probe set it is the upper bound of swd_probe_clock().
+// clock 0 clears the override and restores the host's SWJ_Clock.
+void swd_set_clock(uint32_t clock, uint8_t probe);
+// SWCLK actually generated, in Hertz
+uint32_t swd_get_clock(void);
 uint8_t swd_read_dp(uint8_t adr, uint32_t *val);
 uint8_t swd_write_dp(uint8_t adr, uint32_t val);
 uint8_t swd_read_ap(uint32_t adr, uint32_t *val);
 uint8_t swd_write_ap(uint32_t adr, uint32_t val);
+// Forget the cached SELECT and CSW, the host may have written them with DAP_Transfer
+void swd_forget_state(void);
 uint8_t swd_read_memory(uint32_t address, uint8_t *data, uint32_t size);
 uint8_t swd_write_memory(uint32_t address, uint8_t *data, uint32_t size);
-uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4);
+// Start a flash algorithm function and return while it runs on the target
+uint8_t swd_flash_syscall_start(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4);
+// Check once whether the running function has returned, without waiting
+uint8_t swd_flash_syscall_done(uint8_t *done);
+// Wait for the running function to return and check its result
+uint8_t swd_flash_syscall_wait(uint32_t arg1, uint32_t arg2, flash_algo_return_t return_type);
+uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, flash_algo_return_t return_type);
+// Run a function on the target and return its r0 unchecked
+uint8_t swd_flash_syscall_call(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, uint32_t *result);
 void swd_set_target_reset(uint8_t asserted);
 uint8_t swd_set_target_state_hw(target_state_t state);
 uint8_t swd_set_target_state_sw(target_state_t state);
+uint8_t swd_read_word(uint32_t addr, uint32_t *val);
 uint8_t swd_write_word(uint32_t addr, uint32_t val);
+// Benchmark only (CONFIG_PROGRAMMER_SWD_BENCHMARK): move block data one word per transfer call
+void swd_set_block_per_word(uint8_t enable);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,37 @@
+/**
+ * @file    swd_request.h
+ * @brief   SWD packet request header and parity shared by the SWD transports
+ *
+ * SW_DP.c bit-bangs the packets and spi_swd.c shifts them with the SPI
+ * peripheral, both build the request byte and the data parity from here.
+ */
+#ifndef SWD_REQUEST_H
+#define SWD_REQUEST_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Packet request of each A[3:2] RnW APnDP combination, sent LSB first:
+// Start, APnDP, RnW, A2, A3, Parity, Stop, Park
+#define SWD_REQUEST_PARITY(r)   ((((r) >> 0) ^ ((r) >> 1) ^ ((r) >> 2) ^ ((r) >> 3)) & 1U)
+#define SWD_REQUEST_HEADER(r)   (0x81U | ((r) << 1) | (SWD_REQUEST_PARITY(r) << 5))
+
+// Indexed by request & 0x0F, defined in SW_DP.c
+extern const uint8_t SWD_RequestHeader[16];
+
+// Even parity of a data word, folded down to a nibble and looked up in 0x6996
+static inline uint32_t SWD_Parity(uint32_t val) {
+  val ^= val >> 16;
+  val ^= val >> 8;
+  val ^= val >> 4;
+  return ((0x6996U >> (val & 0x0FU)) & 1U);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
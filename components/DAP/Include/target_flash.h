@@ -0,0 +1,66 @@
+/**
+ * @file    target_flash.h
+ * @brief   Drive a flash algorithm on the target through swd_host
+ */
+#ifndef TARGET_FLASH_H
+#define TARGET_FLASH_H
+
+#include <stdint.h>
+#include "flash_algo.h"
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Double buffered ProgramPage: the next page is uploaded into the free
+// buffer while the target programs the previous one
+typedef struct
+{
+    const flash_algo_t *algo;
+    uint32_t slot;  // Buffer the next page is uploaded to
+    uint32_t addr;  // Arguments of the page being programmed
+    uint32_t size;
+    uint8_t busy;   // ProgramPage running on the target
+} target_flash_pipe_t;
+
+// Function codes passed to the algorithm Init/UnInit
+#define TARGET_FLASH_FUNC_ERASE   1
+#define TARGET_FLASH_FUNC_PROGRAM 2
+#define TARGET_FLASH_FUNC_VERIFY  3
+
+// Halt the target in reset and download the algorithm to its RAM
+dap_err_t target_flash_init(const flash_algo_t *algo);
+// Reset the target and let it run the new firmware
+dap_err_t target_flash_uninit(void);
+
+dap_err_t target_flash_func_init(const flash_algo_t *algo, uint32_t function);
+dap_err_t target_flash_func_uninit(const flash_algo_t *algo, uint32_t function);
+
+dap_err_t target_flash_erase_sector(const flash_algo_t *algo, uint32_t addr);
+dap_err_t target_flash_erase_chip(const flash_algo_t *algo);
+// size must not exceed algo->target.program_buffer_size
+dap_err_t target_flash_program_page(const flash_algo_t *algo, uint32_t addr, const uint8_t *buf, uint32_t size);
+void target_flash_pipe_init(target_flash_pipe_t *pipe, const flash_algo_t *algo);
+// Upload a page and start programming it, waiting for the previous page after the upload
+dap_err_t target_flash_pipe_program(target_flash_pipe_t *pipe, uint32_t addr, const uint8_t *buf, uint32_t size);
+// Wait for the last page started by target_flash_pipe_program()
+dap_err_t target_flash_pipe_flush(target_flash_pipe_t *pipe);
+// Uses the algorithm Verify entry when present, SWD read-back otherwise
+dap_err_t target_flash_verify(const flash_algo_t *algo, uint32_t addr, const uint8_t *buf, uint32_t size);
+
+// Run the on-target CRC32 routine over size bytes (a multiple of 4) at addr,
+// ERROR_ALGO_MISSING if the routine is not loaded
+dap_err_t target_flash_crc32(const flash_algo_t *algo, uint32_t addr, uint32_t size, uint32_t *crc);
+// Same as target_flash_crc32() but compare the result with crc
+dap_err_t target_flash_verify_crc32(const flash_algo_t *algo, uint32_t addr, uint32_t size, uint32_t crc);
+
+// Check on the target that size bytes (a multiple of 4) at addr hold the
+// erased value, ERROR_ALGO_MISSING if the routine is not loaded
+dap_err_t target_flash_blank_check(const flash_algo_t *algo, uint32_t addr, uint32_t size, uint8_t *blank);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * @file    vendor_flash.h
+ * @brief   Flash programming vendor commands for host tools
+ *
+ * A host tool programs the target through the probe's flash algorithm runner
+ * instead of driving the algorithm itself with DAP_Transfer:
+ *
+ *   FlashLoad     upload a flash algorithm file (.FLM or prebuilt) in chunks
+ *   FlashInit     place the algorithm in target RAM, halt the target and download it
+ *   FlashErase    start erasing a range, sectors are erased one after another
+ *   FlashProgram  stream image data, full pages are programmed while the next is sent
+ *   FlashVerify   compare a range against a CRC32 computed on the target
+ *   FlashStatus   advance and report the running erase or program operation
+ *   FlashUninit   finish programming, optionally reset the target to run
+ *
+ * Erase and ProgramPage run on the target while the commands return, the host
+ * polls FlashStatus until the operation is no longer busy. Any other flash
+ * command waits for the running operation first. The host must not access the
+ * target with other commands between FlashInit and FlashUninit.
+ */
+#ifndef VENDOR_FLASH_H
+#define VENDOR_FLASH_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VENDOR_FLASH_ALGO_MAX (64 * 1024)   // Max size of an uploaded algorithm file
+
+// All commands:
+//   return: number of bytes in response (lower 16 bits)
+//           number of bytes in request (upper 16 bits)
+
+//   request:  offset[4] size[2] data[size], offset 0 starts a new file
+//   response: status[1] error[1]
+uint32_t DAP_VendorFlashLoad(const uint8_t *request, uint8_t *response);
+//   request:  ram_start[4] ram_size[4]
+//   response: status[1] error[1] flash_start[4] flash_size[4] page_size[4]
+uint32_t DAP_VendorFlashInit(const uint8_t *request, uint8_t *response);
+//   request:  address[4] size[4], size 0 erases the whole chip
+//   response: status[1] error[1]
+uint32_t DAP_VendorFlashErase(const uint8_t *request, uint8_t *response);
+//   request:  address[4] size[2] data[size]
+//   response: status[1] error[1]
+uint32_t DAP_VendorFlashProgram(const uint8_t *request, uint8_t *response);
+//   request:  address[4] size[4] crc[4]
+//   response: status[1] error[1]
+uint32_t DAP_VendorFlashVerify(const uint8_t *request, uint8_t *response);
+//   request:  (none)
+//   response: status[1] error[1] busy[1] done[4]
+uint32_t DAP_VendorFlashStatus(const uint8_t *request, uint8_t *response);
+//   request:  run[1], non-zero resets the target to run the new firmware
+//   response: status[1] error[1]
+uint32_t DAP_VendorFlashUninit(const uint8_t *request, uint8_t *response);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
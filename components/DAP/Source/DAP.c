@@ -59,6 +59,11 @@
          DAP_Data_t DAP_Data;           // DAP Data
 volatile uint8_t    DAP_TransferAbort;  // Transfer Abort Flag
 
+// SWCLK period in CPU cycles of the bit-banged paths, measured by SWD_CalibrateClock()
+static uint32_t SWJ_FastPeriod = CPU_CLOCK / MAX_SWJ_CLOCK(DELAY_FAST_CYCLES);
+static uint32_t SWJ_SlowPeriod = CPU_CLOCK / MAX_SWJ_CLOCK(DELAY_FAST_CYCLES);
+static uint8_t  SWJ_Calibrated;
+
 
 static const char DAP_FW_Ver [] = DAP_FW_VER;
 
@@ -123,6 +128,18 @@ static uint8_t DAP_Info(uint8_t id, uint8_t *info) {
       info[2] = (uint8_t)(TIMESTAMP_CLOCK >> 16);
       info[3] = (uint8_t)(TIMESTAMP_CLOCK >> 24);
       length = 4U;
+#endif
+      break;
+    case DAP_ID_SWJ_CLOCK:
+#if ((DAP_SWD != 0) || (DAP_JTAG != 0))
+      {
+        uint32_t clock = DAP_GetClock();
+        info[0] = (uint8_t)(clock >>  0);
+        info[1] = (uint8_t)(clock >>  8);
+        info[2] = (uint8_t)(clock >> 16);
+        info[3] = (uint8_t)(clock >> 24);
+        length = 4U;
+      }
 #endif
       break;
     case DAP_ID_UART_RX_BUFFER_SIZE:
@@ -319,6 +336,9 @@ static uint32_t DAP_SWJ_Pins(const uint8_t *request, uint8_t *response) {
   uint32_t select;
   uint32_t wait;
   uint32_t timestamp;
+#if (DAP_SPI_SWD != 0)
+  uint32_t spi_pins;
+#endif
 
   value  = (uint32_t) *(request+0);
   select = (uint32_t) *(request+1);
@@ -327,6 +347,16 @@ static uint32_t DAP_SWJ_Pins(const uint8_t *request, uint8_t *response) {
            (uint32_t)(*(request+4) << 16) |
            (uint32_t)(*(request+5) << 24);
 
+#if (DAP_SPI_SWD != 0)
+  // GPIO writes do not reach SWCLK/SWDIO while the SPI host owns them
+  spi_pins = spi_swd_active() &&
+             ((select & ((1U << DAP_SWJ_SWCLK_TCK) | (1U << DAP_SWJ_SWDIO_TMS))) != 0U);
+  if (spi_pins) {
+    spi_swd_deinit();
+    PORT_SWD_GPIO_SETUP();
+  }
+#endif
+
   if ((select & (1U << DAP_SWJ_SWCLK_TCK)) != 0U) {
     if ((value & (1U << DAP_SWJ_SWCLK_TCK)) != 0U) {
       PIN_SWCLK_TCK_SET();
@@ -402,6 +432,13 @@ static uint32_t DAP_SWJ_Pins(const uint8_t *request, uint8_t *response) {
           (PIN_nTRST_IN()     << DAP_SWJ_nTRST)     |
           (PIN_nRESET_IN()    << DAP_SWJ_nRESET);
 
+#if (DAP_SPI_SWD != 0)
+  // Hand the pins back once the levels have been read
+  if (spi_pins) {
+    spi_swd_init();
+  }
+#endif
+
   *response = (uint8_t)value;
 #else
   *response = 0U;
@@ -414,25 +451,49 @@ static uint32_t DAP_SWJ_Pins(const uint8_t *request, uint8_t *response) {
 // Common clock delay calculation routine
 //   clock:    requested SWJ frequency in Hertz
 //   return:   void
-static void Set_DAP_Clock_Delay(uint32_t clock) {
+void Set_DAP_Clock_Delay(uint32_t clock) {
+  uint32_t period;
   uint32_t delay;
 
-  if (clock >= MAX_SWJ_CLOCK(DELAY_FAST_CYCLES)) {
+  // Round the period up so SWCLK never runs faster than requested
+  period = (CPU_CLOCK + (clock - 1U)) / clock;
+
+  if (period <= SWJ_FastPeriod) {
     DAP_Data.fast_clock  = 1U;
     DAP_Data.clock_delay = 1U;
   } else {
     DAP_Data.fast_clock  = 0U;
 
-    delay = ((CPU_CLOCK/2U) + (clock - 1U)) / clock;
-    if (delay > IO_PORT_WRITE_CYCLES) {
-      delay -= IO_PORT_WRITE_CYCLES;
-      delay  = (delay + (DELAY_SLOW_CYCLES - 1U)) / DELAY_SLOW_CYCLES;
+    // Both half periods of the Slow path wait clock_delay cycles
+    if (period > SWJ_SlowPeriod) {
+      delay = (period - SWJ_SlowPeriod + 1U) / 2U;
     } else {
-      delay  = 1U;
+      delay = 0U;
     }
 
     DAP_Data.clock_delay = delay;
   }
+
+#if (DAP_SPI_SWD != 0)
+  spi_swd_set_clock(clock);
+#endif
+}
+
+
+// Get the SWJ clock actually generated
+//   return:   SWCLK frequency in Hertz
+uint32_t DAP_GetClock(void) {
+#if (DAP_SPI_SWD != 0)
+  if (spi_swd_active()) {
+    return spi_swd_get_clock();
+  }
+#endif
+
+  if (DAP_Data.fast_clock) {
+    return (CPU_CLOCK / SWJ_FastPeriod);
+  }
+
+  return (CPU_CLOCK / (SWJ_SlowPeriod + 2U * DAP_Data.clock_delay));
 }
 
 
@@ -1323,10 +1384,31 @@ static uint32_t DAP_Transfer(const uint8_t *request, uint8_t *response) {
 }
 
 
+// Retry a transfer that returned WAIT inside a block burst
+//   request: A[3:2] RnW APnDP
+//   data:    DATA[31:0]
+//   return:  ACK[2:0]
+#if (DAP_SWD != 0)
+static uint32_t DAP_SWD_TransferRetry(uint32_t request, uint32_t *data) {
+  uint32_t retry;
+  uint32_t ack;
+
+  retry = DAP_Data.transfer.retry_count;
+  do {
+    ack = SWD_Transfer(request, data);
+  } while ((ack == DAP_TRANSFER_WAIT) && retry-- && !DAP_TransferAbort);
+
+  return (ack);
+}
+#endif
+
+
 // Process SWD Transfer Block command and prepare response
 //   request:  pointer to request data
 //   response: pointer to response data
 //   return:   number of bytes in response
+// Words are moved by the SWD_TransferBlockRead/Write bursts, a WAIT ends
+// the burst and only that transfer is retried on the per-word path.
 #if (DAP_SWD != 0)
 static uint32_t DAP_SWD_TransferBlock(const uint8_t *request, uint8_t *response) {
   uint32_t  request_count;
@@ -1334,7 +1416,8 @@ static uint32_t DAP_SWD_TransferBlock(const uint8_t *request, uint8_t *response)
   uint32_t  response_count;
   uint32_t  response_value;
   uint8_t  *response_head;
-  uint32_t  retry;
+  uint32_t  burst;
+  uint32_t  done;
   uint32_t  data;
 
   response_count = 0U;
@@ -1356,30 +1439,42 @@ static uint32_t DAP_SWD_TransferBlock(const uint8_t *request, uint8_t *response)
   request_value = *request++;
   if ((request_value & DAP_TRANSFER_RnW) != 0U) {
     // Read register block
+    burst = request_count;
     if ((request_value & DAP_TRANSFER_APnDP) != 0U) {
       // Post AP read
-      retry = DAP_Data.transfer.retry_count;
-      do {
-        response_value = SWD_Transfer(request_value, NULL);
-      } while ((response_value == DAP_TRANSFER_WAIT) && retry-- && !DAP_TransferAbort);
+      response_value = DAP_SWD_TransferRetry(request_value, NULL);
       if (response_value != DAP_TRANSFER_OK) {
         goto end;
       }
+      // Last AP read comes from RDBUFF
+      burst--;
     }
-    while (request_count--) {
-      // Read DP/AP register
-      if ((request_count == 0U) && ((request_value & DAP_TRANSFER_APnDP) != 0U)) {
-        // Last AP read
-        request_value = DP_RDBUFF | DAP_TRANSFER_RnW;
+    while (burst != 0U) {
+      response_value = SWD_TransferBlockRead(request_value, response, burst, &done);
+      response       += 4U * done;
+      response_count += done;
+      burst          -= done;
+      if (response_value == DAP_TRANSFER_WAIT) {
+        response_value = DAP_SWD_TransferRetry(request_value, &data);
+        if (response_value != DAP_TRANSFER_OK) {
+          goto end;
+        }
+        *response++ = (uint8_t) data;
+        *response++ = (uint8_t)(data >>  8);
+        *response++ = (uint8_t)(data >> 16);
+        *response++ = (uint8_t)(data >> 24);
+        response_count++;
+        burst--;
+      } else if (response_value != DAP_TRANSFER_OK) {
+        goto end;
       }
-      retry = DAP_Data.transfer.retry_count;
-      do {
-        response_value = SWD_Transfer(request_value, &data);
-      } while ((response_value == DAP_TRANSFER_WAIT) && retry-- && !DAP_TransferAbort);
+    }
+    if ((request_value & DAP_TRANSFER_APnDP) != 0U) {
+      // Last AP read
+      response_value = DAP_SWD_TransferRetry(DP_RDBUFF | DAP_TRANSFER_RnW, &data);
       if (response_value != DAP_TRANSFER_OK) {
         goto end;
       }
-      // Store data
       *response++ = (uint8_t) data;
       *response++ = (uint8_t)(data >>  8);
       *response++ = (uint8_t)(data >> 16);
@@ -1388,28 +1483,30 @@ static uint32_t DAP_SWD_TransferBlock(const uint8_t *request, uint8_t *response)
     }
   } else {
     // Write register block
-    while (request_count--) {
-      // Load data
-      data = (uint32_t)(*(request+0) <<  0) |
-             (uint32_t)(*(request+1) <<  8) |
-             (uint32_t)(*(request+2) << 16) |
-             (uint32_t)(*(request+3) << 24);
-      request += 4;
-      // Write DP/AP register
-      retry = DAP_Data.transfer.retry_count;
-      do {
-        response_value = SWD_Transfer(request_value, &data);
-      } while ((response_value == DAP_TRANSFER_WAIT) && retry-- && !DAP_TransferAbort);
-      if (response_value != DAP_TRANSFER_OK) {
+    burst = request_count;
+    while (burst != 0U) {
+      response_value = SWD_TransferBlockWrite(request_value, request, burst, &done);
+      request        += 4U * done;
+      response_count += done;
+      burst          -= done;
+      if (response_value == DAP_TRANSFER_WAIT) {
+        data = (uint32_t)(*(request+0) <<  0) |
+               (uint32_t)(*(request+1) <<  8) |
+               (uint32_t)(*(request+2) << 16) |
+               (uint32_t)(*(request+3) << 24);
+        request += 4;
+        response_value = DAP_SWD_TransferRetry(request_value, &data);
+        if (response_value != DAP_TRANSFER_OK) {
+          goto end;
+        }
+        response_count++;
+        burst--;
+      } else if (response_value != DAP_TRANSFER_OK) {
         goto end;
       }
-      response_count++;
     }
     // Check last write
-    retry = DAP_Data.transfer.retry_count;
-    do {
-      response_value = SWD_Transfer(DP_RDBUFF | DAP_TRANSFER_RnW, NULL);
-    } while ((response_value == DAP_TRANSFER_WAIT) && retry-- && !DAP_TransferAbort);
+    response_value = DAP_SWD_TransferRetry(DP_RDBUFF | DAP_TRANSFER_RnW, NULL);
   }
 
 end:
@@ -1892,6 +1989,14 @@ void DAP_Setup(void) {
   DAP_Data.jtag_dev.count = 0U;                    // JTAG设备数量设为0
 #endif
 
+#if (DAP_SWD != 0)
+  /* 首次初始化时在引脚配置前用周期计数器校准SWCLK,目标不会看到时钟 */
+  if (SWJ_Calibrated == 0U) {
+    SWD_CalibrateClock(&SWJ_FastPeriod, &SWJ_SlowPeriod);
+    SWJ_Calibrated = 1U;
+  }
+#endif
+
   /* 设置DAP时钟和延时参数 */
   Set_DAP_Clock_Delay(DAP_DEFAULT_SWJ_CLOCK);
 
@@ -20,8 +20,13 @@
  *
  ******************************************************************************/
 
+#include <string.h>
+
 #include "DAP_config.h"
 #include "DAP.h"
+#include "swd_host.h"
+#include "vendor_flash.h"
+#include "esp_timer.h"
 
 //**************************************************************************************************
 /** 
@@ -34,6 +39,188 @@ Vendor Commands. Copy this file to the project folder of the Debug Unit and add
 file to the MDK-ARM project under the file group Configuration.
 */
 
+// Bounce buffer for memory data, SWD_TransferBlock() accesses whole words.
+// Data is placed at the offset of the target address within a word, so the
+// word aligned part of an access lands on aligned words.
+static uint32_t vendor_buffer[(DAP_PACKET_SIZE + 3U) / 4U + 1U];
+
+// Memory commands leave SELECT, CSW and TAR changed, the host must not rely
+// on values it set before.
+
+// Process Read Memory command and prepare response
+//   request:  address[4] size[2]
+//   response: status[1] data[size]
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+static uint32_t DAP_VendorReadMemory(const uint8_t *request, uint8_t *response)
+{
+	uint32_t address;
+	uint32_t size;
+	uint8_t *data;
+
+	address = (uint32_t)(*(request+0) <<  0) |
+	          (uint32_t)(*(request+1) <<  8) |
+	          (uint32_t)(*(request+2) << 16) |
+	          (uint32_t)(*(request+3) << 24);
+	size    = (uint32_t)(*(request+4) <<  0) |
+	          (uint32_t)(*(request+5) <<  8);
+	data    = (uint8_t *)vendor_buffer + (address & 3U);
+
+	// Data must fit in one response packet behind command ID and status
+	if ((size > (DAP_PACKET_SIZE - 2U)) || (DAP_Data.debug_port != DAP_PORT_SWD))
+	{
+		*response = DAP_ERROR;
+		return ((6U << 16) | 1U);
+	}
+
+	swd_forget_state();
+	if (!swd_read_memory(address, data, size))
+	{
+		*response = DAP_ERROR;
+		return ((6U << 16) | 1U);
+	}
+
+	*response++ = DAP_OK;
+	memcpy(response, data, size);
+
+	return ((6U << 16) | (1U + size));
+}
+
+// Process Write Memory command and prepare response
+//   request:  address[4] size[2] data[size]
+//   response: status[1]
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+static uint32_t DAP_VendorWriteMemory(const uint8_t *request, uint8_t *response)
+{
+	uint32_t address;
+	uint32_t size;
+	uint8_t *data;
+
+	address = (uint32_t)(*(request+0) <<  0) |
+	          (uint32_t)(*(request+1) <<  8) |
+	          (uint32_t)(*(request+2) << 16) |
+	          (uint32_t)(*(request+3) << 24);
+	size    = (uint32_t)(*(request+4) <<  0) |
+	          (uint32_t)(*(request+5) <<  8);
+	data    = (uint8_t *)vendor_buffer + (address & 3U);
+
+	// Data must fit in one request packet behind command ID, address and size
+	if (size > (DAP_PACKET_SIZE - 7U))
+	{
+		*response = DAP_ERROR;
+		return ((6U << 16) | 1U);
+	}
+
+	memcpy(data, request + 6, size);
+
+	if (DAP_Data.debug_port != DAP_PORT_SWD)
+	{
+		*response = DAP_ERROR;
+		return (((6U + size) << 16) | 1U);
+	}
+
+	swd_forget_state();
+	*response = swd_write_memory(address, data, size) ? DAP_OK : DAP_ERROR;
+
+	return (((6U + size) << 16) | 1U);
+}
+
+// Process Poll Memory command and prepare response
+// Reads a word until (word & mask) == value, replacing host polling loops
+// (halt after step, flash status) with a single exchange.
+//   request:  address[4] mask[4] value[4] interval[2] timeout[2]
+//             interval: time between reads in us, timeout: ms
+//   response: status[1] data[4] elapsed[4]
+//             status: DAP_OK on match, DAP_ERROR on timeout, transfer error
+//             or DAP_TransferAbort
+//             data: last value read, elapsed: us since the first read
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+static uint32_t DAP_VendorPollMemory(const uint8_t *request, uint8_t *response)
+{
+	uint32_t address;
+	uint32_t mask;
+	uint32_t value;
+	uint32_t interval;
+	uint32_t timeout;
+	uint32_t data = 0U;
+	uint32_t elapsed;
+	uint8_t status = DAP_ERROR;
+	int64_t start;
+	int64_t yielded;
+
+	address  = (uint32_t)(*(request+0)  <<  0) |
+	           (uint32_t)(*(request+1)  <<  8) |
+	           (uint32_t)(*(request+2)  << 16) |
+	           (uint32_t)(*(request+3)  << 24);
+	mask     = (uint32_t)(*(request+4)  <<  0) |
+	           (uint32_t)(*(request+5)  <<  8) |
+	           (uint32_t)(*(request+6)  << 16) |
+	           (uint32_t)(*(request+7)  << 24);
+	value    = (uint32_t)(*(request+8)  <<  0) |
+	           (uint32_t)(*(request+9)  <<  8) |
+	           (uint32_t)(*(request+10) << 16) |
+	           (uint32_t)(*(request+11) << 24);
+	interval = (uint32_t)(*(request+12) <<  0) |
+	           (uint32_t)(*(request+13) <<  8);
+	timeout  = (uint32_t)(*(request+14) <<  0) |
+	           (uint32_t)(*(request+15) <<  8);
+
+	DAP_TransferAbort = 0U;
+	start = esp_timer_get_time();
+	yielded = start;
+
+	if (((address & 3U) == 0U) && (DAP_Data.debug_port == DAP_PORT_SWD))
+	{
+		swd_forget_state();
+		while (swd_read_word(address, &data))
+		{
+			if ((data & mask) == value)
+			{
+				status = DAP_OK;
+				break;
+			}
+
+			if (DAP_TransferAbort || ((esp_timer_get_time() - start) >= ((int64_t)timeout * 1000)))
+			{
+				break;
+			}
+
+			// Long intervals give the CPU to other tasks, short ones busy wait
+			if (interval >= (portTICK_PERIOD_MS * 1000U))
+			{
+				vTaskDelay((interval / 1000U) / portTICK_PERIOD_MS);
+			}
+			else
+			{
+				PIN_DELAY_SLOW(interval * (((CPU_CLOCK/1000000U) + (DELAY_SLOW_CYCLES-1U)) / DELAY_SLOW_CYCLES));
+
+				// Still give up the CPU once per tick so IDLE can feed the watchdog
+				if ((esp_timer_get_time() - yielded) >= (portTICK_PERIOD_MS * 1000))
+				{
+					vTaskDelay(1);
+					yielded = esp_timer_get_time();
+				}
+			}
+		}
+	}
+
+	elapsed = (uint32_t)(esp_timer_get_time() - start);
+
+	*response++ = status;
+	*response++ = (uint8_t)(data >>  0);
+	*response++ = (uint8_t)(data >>  8);
+	*response++ = (uint8_t)(data >> 16);
+	*response++ = (uint8_t)(data >> 24);
+	*response++ = (uint8_t)(elapsed >>  0);
+	*response++ = (uint8_t)(elapsed >>  8);
+	*response++ = (uint8_t)(elapsed >> 16);
+	*response++ = (uint8_t)(elapsed >> 24);
+
+	return ((16U << 16) | 9U);
+}
+
 /** Process DAP Vendor Command and prepare Response Data
 \param request   pointer to request data
 \param response  pointer to response data
@@ -88,25 +275,35 @@ uint32_t DAP_ProcessVendorCommand(const uint8_t *request, uint8_t *response)
 		break;
 	case ID_DAP_Vendor15:
 		break;
-	case ID_DAP_Vendor16:
+	case ID_DAP_VendorReadMemory:
+		num += DAP_VendorReadMemory(request, response);
 		break;
-	case ID_DAP_Vendor17:
+	case ID_DAP_VendorWriteMemory:
+		num += DAP_VendorWriteMemory(request, response);
 		break;
-	case ID_DAP_Vendor18:
+	case ID_DAP_VendorFlashLoad:
+		num += DAP_VendorFlashLoad(request, response);
 		break;
-	case ID_DAP_Vendor19:
+	case ID_DAP_VendorFlashInit:
+		num += DAP_VendorFlashInit(request, response);
 		break;
-	case ID_DAP_Vendor20:
+	case ID_DAP_VendorFlashErase:
+		num += DAP_VendorFlashErase(request, response);
 		break;
-	case ID_DAP_Vendor21:
+	case ID_DAP_VendorFlashProgram:
+		num += DAP_VendorFlashProgram(request, response);
 		break;
-	case ID_DAP_Vendor22:
+	case ID_DAP_VendorFlashVerify:
+		num += DAP_VendorFlashVerify(request, response);
 		break;
-	case ID_DAP_Vendor23:
+	case ID_DAP_VendorFlashStatus:
+		num += DAP_VendorFlashStatus(request, response);
 		break;
-	case ID_DAP_Vendor24:
+	case ID_DAP_VendorFlashUninit:
+		num += DAP_VendorFlashUninit(request, response);
 		break;
-	case ID_DAP_Vendor25:
+	case ID_DAP_VendorPollMemory:
+		num += DAP_VendorPollMemory(request, response);
 		break;
 	case ID_DAP_Vendor26:
 		break;
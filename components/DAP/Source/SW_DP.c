@@ -27,6 +27,7 @@
 
 #include "DAP_config.h"
 #include "DAP.h"
+#include "swd_request.h"
 
 #if defined(__CC_ARM)
 #pragma push
@@ -78,6 +79,13 @@ __WEAK void SWJ_Sequence (uint32_t count, const uint8_t *data) {
   uint32_t val;
   uint32_t n;
 
+#if (DAP_SPI_SWD != 0)
+  if (spi_swd_active()) {
+    spi_swd_sequence_write(count, data);
+    return;
+  }
+#endif
+
   val = 0U;
   n = 0U;
   while (count--) {
@@ -114,6 +122,17 @@ __WEAK void SWD_Sequence (uint32_t info, const uint8_t *swdo, uint8_t *swdi) {
     n = 64U;
   }
 
+#if (DAP_SPI_SWD != 0)
+  if (spi_swd_active()) {
+    if (info & SWD_SEQUENCE_DIN) {
+      spi_swd_sequence_read(n, swdi);
+    } else {
+      spi_swd_sequence_write(n, swdo);
+    }
+    return;
+  }
+#endif
+
   if (info & SWD_SEQUENCE_DIN) {
     while (n) {
       val = 0U;
@@ -141,6 +160,14 @@ __WEAK void SWD_Sequence (uint32_t info, const uint8_t *swdo, uint8_t *swdi) {
 #if (DAP_SWD != 0)
 
 
+const uint8_t SWD_RequestHeader[16] = {
+  SWD_REQUEST_HEADER(0U),  SWD_REQUEST_HEADER(1U),  SWD_REQUEST_HEADER(2U),  SWD_REQUEST_HEADER(3U),
+  SWD_REQUEST_HEADER(4U),  SWD_REQUEST_HEADER(5U),  SWD_REQUEST_HEADER(6U),  SWD_REQUEST_HEADER(7U),
+  SWD_REQUEST_HEADER(8U),  SWD_REQUEST_HEADER(9U),  SWD_REQUEST_HEADER(10U), SWD_REQUEST_HEADER(11U),
+  SWD_REQUEST_HEADER(12U), SWD_REQUEST_HEADER(13U), SWD_REQUEST_HEADER(14U), SWD_REQUEST_HEADER(15U)
+};
+
+
 // SWD Transfer I/O
 //   request: A[3:2] RnW APnDP
 //   data:    DATA[31:0]
@@ -155,23 +182,15 @@ static uint8_t SWD_Transfer##speed (uint32_t request, uint32_t *data) {
   uint32_t n;                                                                   \
                                                                                 \
   /* Packet Request */                                                          \
-  parity = 0U;                                                                  \
-  SW_WRITE_BIT(1U);                     /* Start Bit */                         \
-  bit = request >> 0;                                                           \
-  SW_WRITE_BIT(bit);                    /* APnDP Bit */                         \
-  parity += bit;                                                                \
-  bit = request >> 1;                                                           \
-  SW_WRITE_BIT(bit);                    /* RnW Bit */                           \
-  parity += bit;                                                                \
-  bit = request >> 2;                                                           \
-  SW_WRITE_BIT(bit);                    /* A2 Bit */                            \
-  parity += bit;                                                                \
-  bit = request >> 3;                                                           \
-  SW_WRITE_BIT(bit);                    /* A3 Bit */                            \
-  parity += bit;                                                                \
-  SW_WRITE_BIT(parity);                 /* Parity Bit */                        \
-  SW_WRITE_BIT(0U);                     /* Stop Bit */                          \
-  SW_WRITE_BIT(1U);                     /* Park Bit */                          \
+  val = SWD_RequestHeader[request & 0x0FU];                                     \
+  SW_WRITE_BIT(val >> 0);               /* Start Bit */                         \
+  SW_WRITE_BIT(val >> 1);               /* APnDP Bit */                         \
+  SW_WRITE_BIT(val >> 2);               /* RnW Bit */                           \
+  SW_WRITE_BIT(val >> 3);               /* A2 Bit */                            \
+  SW_WRITE_BIT(val >> 4);               /* A3 Bit */                            \
+  SW_WRITE_BIT(val >> 5);               /* Parity Bit */                        \
+  SW_WRITE_BIT(val >> 6);               /* Stop Bit */                          \
+  SW_WRITE_BIT(val >> 7);               /* Park Bit */                          \
                                                                                 \
   /* Turnaround */                                                              \
   PIN_SWDIO_OUT_DISABLE();                                                      \
@@ -192,15 +211,18 @@ static uint8_t SWD_Transfer##speed (uint32_t request, uint32_t *data) {
     if (request & DAP_TRANSFER_RnW) {                                           \
       /* Read data */                                                           \
       val = 0U;                                                                 \
-      parity = 0U;                                                              \
-      for (n = 32U; n; n--) {                                                   \
-        SW_READ_BIT(bit);               /* Read RDATA[0:31] */                  \
-        parity += bit;                                                          \
-        val >>= 1;                                                              \
-        val  |= bit << 31;                                                      \
+      for (n = 0U; n < 32U; n += 4U) {  /* Read RDATA[0:31] */                  \
+        SW_READ_BIT(bit);                                                       \
+        val |= bit << (n + 0U);                                                 \
+        SW_READ_BIT(bit);                                                       \
+        val |= bit << (n + 1U);                                                 \
+        SW_READ_BIT(bit);                                                       \
+        val |= bit << (n + 2U);                                                 \
+        SW_READ_BIT(bit);                                                       \
+        val |= bit << (n + 3U);                                                 \
       }                                                                         \
       SW_READ_BIT(bit);                 /* Read Parity */                       \
-      if ((parity ^ bit) & 1U) {                                                \
+      if (SWD_Parity(val) ^ bit) {                                              \
         ack = DAP_TRANSFER_ERROR;                                               \
       }                                                                         \
       if (data) { *data = val; }                                                \
@@ -217,11 +239,12 @@ static uint8_t SWD_Transfer##speed (uint32_t request, uint32_t *data) {
       PIN_SWDIO_OUT_ENABLE();                                                   \
       /* Write data */                                                          \
       val = *data;                                                              \
-      parity = 0U;                                                              \
-      for (n = 32U; n; n--) {                                                   \
-        SW_WRITE_BIT(val);              /* Write WDATA[0:31] */                 \
-        parity += val;                                                          \
-        val >>= 1;                                                              \
+      parity = SWD_Parity(val);                                                 \
+      for (n = 0U; n < 32U; n += 4U) {  /* Write WDATA[0:31] */                 \
+        SW_WRITE_BIT(val >> (n + 0U));                                          \
+        SW_WRITE_BIT(val >> (n + 1U));                                          \
+        SW_WRITE_BIT(val >> (n + 2U));                                          \
+        SW_WRITE_BIT(val >> (n + 3U));                                          \
       }                                                                         \
       SW_WRITE_BIT(parity);             /* Write Parity Bit */                  \
     }                                                                           \
@@ -273,35 +296,301 @@ static uint8_t SWD_Transfer##speed (uint32_t request, uint32_t *data) {
 }
 
 
+// Measure one SWCLK period in CPU cycles, half write and half read bits.
+// Only the timing matters, the pins do not need to be enabled.
+#define SWD_CALIBRATE_BITS 32U
+
+#define SWD_CalibrateFunction(speed)    /**/                                    \
+static uint32_t SWD_Calibrate##speed (void) {                                   \
+  uint32_t start;                                                               \
+  uint32_t bit;                                                                 \
+  uint32_t n;                                                                   \
+                                                                                \
+  start = esp_cpu_get_cycle_count();                                            \
+  for (n = SWD_CALIBRATE_BITS; n; n--) {                                        \
+    SW_WRITE_BIT(1U);                                                           \
+    SW_READ_BIT(bit);                                                           \
+  }                                                                             \
+  (void)bit;                                                                    \
+                                                                                \
+  return ((esp_cpu_get_cycle_count() - start) / (2U * SWD_CALIBRATE_BITS));     \
+}
+
+
 #undef  PIN_DELAY
 #define PIN_DELAY() PIN_DELAY_FAST()
 SWD_TransferFunction(Fast)
+SWD_CalibrateFunction(Fast)
+
+#undef  PIN_DELAY
+#define PIN_DELAY() PIN_DELAY_SLOW(DAP_Data.clock_delay)
+SWD_TransferFunction(Slow)
+SWD_CalibrateFunction(Slow)
 
-// #undef  PIN_DELAY
-// #define PIN_DELAY() PIN_DELAY_SLOW(DAP_Data.clock_delay)
-// SWD_TransferFunction(Slow)
+
+// Burst kernels for DAP_TransferBlock, moving words straight between the
+// byte packed command buffers and the wire. WAIT ends the burst so the
+// caller can retry it without holding the critical section.
+#define SWD_BlockFunction(speed)        /**/                                    \
+static uint32_t SWD_ReadBlock##speed (uint32_t request, uint8_t *data,          \
+                                      uint32_t count, uint8_t *ack) {          \
+  uint32_t value;                                                               \
+  uint32_t n;                                                                   \
+                                                                                \
+  *ack = DAP_TRANSFER_OK;                                                       \
+  for (n = 0U; n < count; n++) {                                               \
+    *ack = SWD_Transfer##speed(request, &value);                                \
+    if (*ack != DAP_TRANSFER_OK) {                                              \
+      break;                                                                    \
+    }                                                                           \
+    *data++ = (uint8_t)(value >>  0);                                           \
+    *data++ = (uint8_t)(value >>  8);                                           \
+    *data++ = (uint8_t)(value >> 16);                                           \
+    *data++ = (uint8_t)(value >> 24);                                           \
+  }                                                                             \
+  return (n);                                                                   \
+}                                                                               \
+                                                                                \
+static uint32_t SWD_WriteBlock##speed (uint32_t request, const uint8_t *data,   \
+                                       uint32_t count, uint8_t *ack) {         \
+  uint32_t value;                                                               \
+  uint32_t n;                                                                   \
+                                                                                \
+  *ack = DAP_TRANSFER_OK;                                                       \
+  for (n = 0U; n < count; n++) {                                               \
+    value = (uint32_t)(*(data+0) <<  0) |                                       \
+            (uint32_t)(*(data+1) <<  8) |                                       \
+            (uint32_t)(*(data+2) << 16) |                                       \
+            (uint32_t)(*(data+3) << 24);                                        \
+    *ack = SWD_Transfer##speed(request, &value);                                \
+    if (*ack != DAP_TRANSFER_OK) {                                              \
+      break;                                                                    \
+    }                                                                           \
+    data += 4;                                                                  \
+  }                                                                             \
+  return (n);                                                                   \
+}
+
+SWD_BlockFunction(Fast)
+SWD_BlockFunction(Slow)
+
+// Longest time a burst keeps interrupts off, far below the interrupt
+// watchdog (CONFIG_ESP_INT_WDT_TIMEOUT_MS). The lock is released and
+// taken again between chunks, so the budget holds at any SWJ clock.
+#define SWD_BURST_BUDGET_US 1000U
+
+// Words one critical section may move at the current clock
+//   return: chunk size, at least one word
+static uint32_t SWD_BurstWords(void) {
+  uint32_t cycles;
+  uint32_t words;
+
+  // Request, ACK, data, parity, turnarounds and idle cycles of one transfer
+  cycles = 8U + 3U + 33U + (2U * DAP_Data.swd_conf.turnaround) + DAP_Data.transfer.idle_cycles;
+  words  = (uint32_t)(((uint64_t)DAP_GetClock() * SWD_BURST_BUDGET_US) / (1000000U * cycles));
+
+  return (words != 0U) ? words : 1U;
+}
+
+// Calibrate the bit-banged SWCLK
+//   fast_period: CPU cycles of one SWCLK period on the Fast path
+//   slow_period: CPU cycles of one SWCLK period on the Slow path with zero delay
+//   return:      none
+void SWD_CalibrateClock(uint32_t *fast_period, uint32_t *slow_period) {
+  uint32_t delay = DAP_Data.clock_delay;
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+  DAP_Data.clock_delay = 0U;
+
+  portENTER_CRITICAL(&lock);
+  // First pass warms the instruction cache
+  SWD_CalibrateFast();
+  *fast_period = SWD_CalibrateFast();
+  SWD_CalibrateSlow();
+  *slow_period = SWD_CalibrateSlow();
+  portEXIT_CRITICAL(&lock);
+
+  DAP_Data.clock_delay = delay;
+}
 
 // SWD Transfer I/O
 //   request: A[3:2] RnW APnDP
 //   data:    DATA[31:0]
 //   return:  ACK[2:0]
 __WEAK uint8_t  SWD_Transfer(uint32_t request, uint32_t *data) {
-  // if (DAP_Data.fast_clock) {
-  //   return SWD_TransferFast(request, data);
-  // } else {
-  //   return SWD_TransferSlow(request, data);
-  // }
-
   uint8_t ret = 0;
   portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
 
+#if (DAP_SPI_SWD != 0)
+  if (spi_swd_active()) {
+    return spi_swd_transfer(request, data);
+  }
+#endif
+
   portENTER_CRITICAL(&lock);
-  ret = SWD_TransferFast(request, data);
+  if (DAP_Data.fast_clock) {
+    ret = SWD_TransferFast(request, data);
+  } else {
+    ret = SWD_TransferSlow(request, data);
+  }
   portEXIT_CRITICAL(&lock);
 
   return ret;
 }
 
+// SWD Transfer I/O of a block of words to/from the same register
+//   request: A[3:2] RnW APnDP
+//   data:    DATA[31:0] of each transfer, NULL to discard read data
+//   count:   number of transfers
+//   retry:   WAIT retries allowed per transfer
+//   return:  ACK[2:0] of the last transfer, stops at the first one not OK
+// Runs as bursts like DAP_TransferBlock: WAIT ends the burst and the stalled
+// word is retried outside the critical section before the burst resumes.
+// The burst kernels split count into chunks of SWD_BurstWords(), so a whole
+// auto-increment page never keeps interrupts off longer than the budget.
+__WEAK uint8_t  SWD_TransferBlock(uint32_t request, uint32_t *data, uint32_t count, uint32_t retry) {
+  uint8_t ack = DAP_TRANSFER_OK;
+  uint32_t done;
+  uint32_t n;
+
+  while (count != 0U) {
+    if (data == NULL) {
+      ack = SWD_Transfer(request, NULL);
+      done = (ack == DAP_TRANSFER_OK) ? 1U : 0U;
+    } else if (request & DAP_TRANSFER_RnW) {
+      ack = SWD_TransferBlockRead(request, (uint8_t *)data, count, &done);
+      data += done;
+    } else {
+      ack = SWD_TransferBlockWrite(request, (const uint8_t *)data, count, &done);
+      data += done;
+    }
+    count -= done;
+
+    if (ack == DAP_TRANSFER_WAIT) {
+      n = retry;
+      while ((ack == DAP_TRANSFER_WAIT) && n--) {
+        ack = SWD_Transfer(request, data);
+      }
+      if (ack == DAP_TRANSFER_OK) {
+        count--;
+        if (data) {
+          data++;
+        }
+      }
+    }
+    if (ack != DAP_TRANSFER_OK) {
+      break;
+    }
+  }
+
+  return ack;
+}
+
+
+// SWD burst read of a block of words from the same register
+//   request: A[3:2] RnW APnDP
+//   data:    DATA[31:0] of each transfer, little endian, no alignment needed
+//   count:   number of transfers
+//   done:    number of transfers completed
+//   return:  ACK[2:0] of the last transfer, stops at the first one not OK
+//            without retrying WAIT
+// Interrupts are off for one chunk of SWD_BurstWords() at a time.
+uint8_t SWD_TransferBlockRead(uint32_t request, uint8_t *data, uint32_t count, uint32_t *done) {
+  uint8_t ack = DAP_TRANSFER_OK;
+  uint32_t value;
+  uint32_t chunk;
+  uint32_t n;
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+#if (DAP_SPI_SWD != 0)
+  if (spi_swd_active()) {
+    for (n = 0U; n < count; n++) {
+      ack = spi_swd_transfer(request, &value);
+      if (ack != DAP_TRANSFER_OK) {
+        break;
+      }
+      *data++ = (uint8_t)(value >>  0);
+      *data++ = (uint8_t)(value >>  8);
+      *data++ = (uint8_t)(value >> 16);
+      *data++ = (uint8_t)(value >> 24);
+    }
+    *done = n;
+    return ack;
+  }
+#endif
+  (void)value;
+
+  chunk = SWD_BurstWords();
+  n = 0U;
+  while ((n < count) && (ack == DAP_TRANSFER_OK)) {
+    if (chunk > (count - n)) {
+      chunk = count - n;
+    }
+    portENTER_CRITICAL(&lock);
+    if (DAP_Data.fast_clock) {
+      n += SWD_ReadBlockFast(request, data + (n * 4U), chunk, &ack);
+    } else {
+      n += SWD_ReadBlockSlow(request, data + (n * 4U), chunk, &ack);
+    }
+    portEXIT_CRITICAL(&lock);
+  }
+
+  *done = n;
+  return ack;
+}
+
+// SWD burst write of a block of words to the same register
+//   request: A[3:2] RnW APnDP
+//   data:    DATA[31:0] of each transfer, little endian, no alignment needed
+//   count:   number of transfers
+//   done:    number of transfers completed
+//   return:  ACK[2:0] of the last transfer, stops at the first one not OK
+//            without retrying WAIT
+// Interrupts are off for one chunk of SWD_BurstWords() at a time.
+uint8_t SWD_TransferBlockWrite(uint32_t request, const uint8_t *data, uint32_t count, uint32_t *done) {
+  uint8_t ack = DAP_TRANSFER_OK;
+  uint32_t value;
+  uint32_t chunk;
+  uint32_t n;
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+#if (DAP_SPI_SWD != 0)
+  if (spi_swd_active()) {
+    for (n = 0U; n < count; n++) {
+      value = (uint32_t)(*(data+0) <<  0) |
+              (uint32_t)(*(data+1) <<  8) |
+              (uint32_t)(*(data+2) << 16) |
+              (uint32_t)(*(data+3) << 24);
+      ack = spi_swd_transfer(request, &value);
+      if (ack != DAP_TRANSFER_OK) {
+        break;
+      }
+      data += 4;
+    }
+    *done = n;
+    return ack;
+  }
+#endif
+  (void)value;
+
+  chunk = SWD_BurstWords();
+  n = 0U;
+  while ((n < count) && (ack == DAP_TRANSFER_OK)) {
+    if (chunk > (count - n)) {
+      chunk = count - n;
+    }
+    portENTER_CRITICAL(&lock);
+    if (DAP_Data.fast_clock) {
+      n += SWD_WriteBlockFast(request, data + (n * 4U), chunk, &ack);
+    } else {
+      n += SWD_WriteBlockSlow(request, data + (n * 4U), chunk, &ack);
+    }
+    portEXIT_CRITICAL(&lock);
+  }
+
+  *done = n;
+  return ack;
+}
 
 #endif  /* (DAP_SWD != 0) */
 
@@ -123,6 +123,19 @@ static const char *const error_message[] = {
     // ERROR_BL_UPDT_BAD_CRC
     "The bootloader CRC did not pass.",
 
+    /* Offline programmer */
+
+    // ERROR_ALGO_FILE
+    "The flash algorithm file is missing or malformed.",
+    // ERROR_ALGO_RAM
+    "The flash algorithm does not fit in the target RAM.",
+    // ERROR_IMAGE_FILE
+    "The program image file is missing or cannot be read.",
+    // ERROR_IMAGE_BOUNDS
+    "The program image does not fit in the target flash.",
+    // ERROR_TARGET_BUSY
+    "The target is in use by a debugger session.",
+
 };
 
 #endif // DAPLINK_NO_ERROR_MESSAGES
@@ -226,6 +239,19 @@ static dap_err_type_t error_type[] = {
     ERROR_TYPE_INTERFACE,
     // ERROR_BL_UPDT_BAD_CRC
     ERROR_TYPE_INTERFACE,
+
+    /* Offline programmer */
+
+    // ERROR_ALGO_FILE
+    ERROR_TYPE_USER,
+    // ERROR_ALGO_RAM
+    ERROR_TYPE_USER,
+    // ERROR_IMAGE_FILE
+    ERROR_TYPE_USER,
+    // ERROR_IMAGE_BOUNDS
+    ERROR_TYPE_USER,
+    // ERROR_TARGET_BUSY
+    ERROR_TYPE_TRANSIENT,
 };
 
 const char *error_get_string(dap_err_t error)
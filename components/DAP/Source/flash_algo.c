@@ -0,0 +1,261 @@
+/**
+ * @file    flash_algo.c
+ * @brief   Flash algorithm loaded from a file at runtime
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flash_algo.h"
+#include "flm.h"
+
+#define ALIGN_UP(x, a) (((x) + ((a) - 1)) & ~((a) - 1))
+
+// BKPT #0 ; B .
+#define FLASH_ALGO_BKPT_STUB 0xE7FEBE00
+
+// Helper routines, Thumb code using r0-r5 only so no stack is needed
+static const uint32_t flash_algo_helper_code[] = {
+	// CRC32 (IEEE 802.3, reflected, same as zlib) of r1 bytes at r0, r1 a multiple of 4.
+	// Returns the CRC in r0.
+	0x43D22200, // movs r2, #0 ; mvns r2, r2
+	0x29004B07, // ldr r3, =0xEDB88320 ; cmp r1, #0
+	0x6804D00A, // beq done ; word: ldr r4, [r0]
+	0x40623004, // adds r0, #4 ; eors r2, r4
+	0x08522520, // movs r5, #32 ; bit: lsrs r2, r2, #1
+	0x405AD300, // bcc skip ; eors r2, r3
+	0xD1FA3D01, // skip: subs r5, #1 ; bne bit
+	0xD1F43904, // subs r1, #4 ; bne word
+	0x477043D0, // done: mvns r0, r2 ; bx lr
+	0xEDB88320,
+
+	// Blank check of r1 bytes at r0 against the word r2, r1 a multiple of 4.
+	// Returns 0 if every word matches, 1 otherwise.
+	0xD0052900, // cmp r1, #0 ; beq blank
+	0x42936803, // loop: ldr r3, [r0] ; cmp r3, r2
+	0x3004D104, // bne dirty ; adds r0, #4
+	0xD1F93904, // subs r1, #4 ; bne loop
+	0x47702000, // blank: movs r0, #0 ; bx lr
+	0x47702001, // dirty: movs r0, #1 ; bx lr
+};
+
+#define FLASH_ALGO_HELPER_SIZE          sizeof(flash_algo_helper_code)
+#define FLASH_ALGO_HELPER_CRC32         0x00
+#define FLASH_ALGO_HELPER_BLANK_CHECK   0x28
+
+uint32_t *flash_algo_alloc_blob(uint32_t blob_size)
+{
+	uint32_t *blob = calloc(1, FLASH_ALGO_HEADER_SIZE + ALIGN_UP(blob_size, 4) + FLASH_ALGO_HELPER_SIZE);
+
+	if (blob != NULL)
+	{
+		blob[0] = FLASH_ALGO_BKPT_STUB;
+	}
+
+	return blob;
+}
+
+static uint32_t flash_algo_entry(uint32_t code_base, uint32_t offset)
+{
+	return (offset == FLASH_ALGO_ENTRY_NONE) ? 0 : code_base + offset;
+}
+
+dap_err_t flash_algo_place(flash_algo_t *algo, uint32_t *blob, uint32_t blob_size,
+						   const flash_algo_entries_t *entries, uint32_t ram_start, uint32_t ram_size)
+{
+	program_target_t *target = &algo->target;
+	uint32_t code_base = ram_start + FLASH_ALGO_HEADER_SIZE;
+	uint32_t algo_size = FLASH_ALGO_HEADER_SIZE + ALIGN_UP(blob_size, 4);
+	uint32_t program_buffer = ram_start + ALIGN_UP(algo_size, 8);
+	uint32_t stack_top = (ram_start + ram_size) & ~7U;
+
+	// Init, UnInit, EraseSector and ProgramPage are mandatory
+	if ((entries->init == FLASH_ALGO_ENTRY_NONE) || (entries->uninit == FLASH_ALGO_ENTRY_NONE) ||
+		(entries->erase_sector == FLASH_ALGO_ENTRY_NONE) || (entries->program_page == FLASH_ALGO_ENTRY_NONE))
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	if ((algo->page_size == 0) ||
+		(program_buffer + algo->page_size + FLASH_ALGO_STACK_SIZE > stack_top))
+	{
+		return ERROR_ALGO_RAM;
+	}
+
+	target->init = flash_algo_entry(code_base, entries->init);
+	target->uninit = flash_algo_entry(code_base, entries->uninit);
+	target->erase_chip = flash_algo_entry(code_base, entries->erase_chip);
+	target->erase_sector = flash_algo_entry(code_base, entries->erase_sector);
+	target->program_page = flash_algo_entry(code_base, entries->program_page);
+	target->verify = flash_algo_entry(code_base, entries->verify);
+
+	target->sys_call_s.breakpoint = ram_start + 1;
+	target->sys_call_s.static_base = code_base + entries->static_base;
+	target->sys_call_s.stack_pointer = stack_top;
+
+	// Helper routines go right after the algorithm when RAM allows
+	if (program_buffer + FLASH_ALGO_HELPER_SIZE + algo->page_size + FLASH_ALGO_STACK_SIZE <= stack_top)
+	{
+		memcpy((uint8_t *)blob + algo_size, flash_algo_helper_code, FLASH_ALGO_HELPER_SIZE);
+		algo->crc32 = ram_start + algo_size + FLASH_ALGO_HELPER_CRC32 + 1;
+		algo->blank_check = ram_start + algo_size + FLASH_ALGO_HELPER_BLANK_CHECK + 1;
+		algo_size += FLASH_ALGO_HELPER_SIZE;
+		program_buffer = ram_start + ALIGN_UP(algo_size, 8);
+	}
+	else
+	{
+		algo->crc32 = 0;
+		algo->blank_check = 0;
+	}
+
+	// A second page buffer lets the next page upload while the previous one programs
+	algo->program_buffer_count = (program_buffer + 2 * algo->page_size + FLASH_ALGO_STACK_SIZE <= stack_top) ? 2 : 1;
+
+	target->program_buffer = program_buffer;
+	target->program_buffer_size = algo->page_size;
+	target->algo_start = ram_start;
+	target->algo_size = algo_size;
+	target->algo_blob = blob;
+
+	return ERROR_SUCCESS;
+}
+
+static dap_err_t flash_algo_load_file(FILE *fp, uint32_t ram_start, uint32_t ram_size, flash_algo_t *algo)
+{
+	flash_algo_file_header_t header;
+	flash_algo_entries_t entries;
+	uint32_t *blob;
+	dap_err_t ret;
+	uint32_t i;
+
+	if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != FLASH_ALGO_FILE_MAGIC)
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	if (header.sector_count == 0 || header.sector_count > FLASH_ALGO_MAX_SECTORS)
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	if (header.blob_size == 0 || header.blob_size > ram_size)
+	{
+		return ERROR_ALGO_RAM;
+	}
+
+	if (fread(algo->sectors, sizeof(sector_info_t), header.sector_count, fp) != header.sector_count)
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	for (i = 0; i < header.sector_count; i++)
+	{
+		if (algo->sectors[i].size == 0 || (i > 0 && algo->sectors[i].start <= algo->sectors[i - 1].start))
+		{
+			return ERROR_ALGO_FILE;
+		}
+	}
+
+	algo->sector_count = header.sector_count;
+	algo->flash_start = header.flash_start;
+	algo->flash_size = header.flash_size;
+	algo->page_size = header.page_size;
+	algo->erased_value = (uint8_t)header.erased_value;
+
+	entries.init = header.init;
+	entries.uninit = header.uninit;
+	entries.erase_chip = header.erase_chip;
+	entries.erase_sector = header.erase_sector;
+	entries.program_page = header.program_page;
+	entries.verify = header.verify;
+	entries.static_base = header.static_base;
+
+	blob = flash_algo_alloc_blob(header.blob_size);
+	if (blob == NULL)
+	{
+		return ERROR_INTERNAL;
+	}
+
+	if (fread((uint8_t *)blob + FLASH_ALGO_HEADER_SIZE, 1, header.blob_size, fp) != header.blob_size)
+	{
+		free(blob);
+		return ERROR_ALGO_FILE;
+	}
+
+	ret = flash_algo_place(algo, blob, header.blob_size, &entries, ram_start, ram_size);
+	if (ret != ERROR_SUCCESS)
+	{
+		free(blob);
+	}
+
+	return ret;
+}
+
+dap_err_t flash_algo_load_stream(FILE *fp, uint32_t ram_start, uint32_t ram_size, flash_algo_t *algo)
+{
+	uint32_t magic;
+
+	memset(algo, 0, sizeof(*algo));
+
+	// Keil .FLM (ELF) or the prebuilt algorithm format
+	if (fread(&magic, sizeof(magic), 1, fp) != 1 || fseek(fp, 0, SEEK_SET) != 0)
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	if (magic == FLASH_ALGO_FILE_MAGIC)
+	{
+		return flash_algo_load_file(fp, ram_start, ram_size, algo);
+	}
+
+	return flm_load(fp, ram_start, ram_size, algo);
+}
+
+dap_err_t flash_algo_load(const char *path, uint32_t ram_start, uint32_t ram_size, flash_algo_t *algo)
+{
+	dap_err_t ret;
+	FILE *fp;
+
+	memset(algo, 0, sizeof(*algo));
+
+	fp = fopen(path, "rb");
+	if (fp == NULL)
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	ret = flash_algo_load_stream(fp, ram_start, ram_size, algo);
+	fclose(fp);
+
+	return ret;
+}
+
+void flash_algo_free(flash_algo_t *algo)
+{
+	free(algo->target.algo_blob);
+	algo->target.algo_blob = NULL;
+}
+
+uint32_t flash_algo_sector(const flash_algo_t *algo, uint32_t addr, uint32_t *size)
+{
+	int i;
+
+	*size = 0;
+
+	if (addr < algo->flash_start || addr - algo->flash_start >= algo->flash_size)
+	{
+		return 0;
+	}
+
+	for (i = (int)algo->sector_count - 1; i >= 0; i--)
+	{
+		if (addr >= algo->sectors[i].start)
+		{
+			*size = algo->sectors[i].size;
+			return algo->sectors[i].start + (addr - algo->sectors[i].start) / *size * *size;
+		}
+	}
+
+	return 0;
+}
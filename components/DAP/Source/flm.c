@@ -0,0 +1,432 @@
+/**
+ * @file    flm.c
+ * @brief   Keil MDK .FLM flash algorithm loader
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "flm.h"
+
+#define ELF_CLASS_32        1
+#define ELF_DATA_LSB        1
+#define ELF_MACHINE_ARM     40
+
+#define ELF_SHT_SYMTAB      2
+#define ELF_SHT_NOBITS      8
+#define ELF_SHF_ALLOC       0x2
+#define ELF_SHN_UNDEF       0
+
+// Longest name looked up in the section and symbol string tables, plus NUL
+#define FLM_NAME_MAX        12
+
+// struct FlashDevice from FlashOS.H
+#define FLM_DEV_ADR_OFFSET      132
+#define FLM_DEV_SECTORS_OFFSET  160
+#define FLM_SECTOR_END          0xFFFFFFFF
+
+typedef struct __attribute__((packed))
+{
+	uint8_t ident[16];
+	uint16_t type;
+	uint16_t machine;
+	uint32_t version;
+	uint32_t entry;
+	uint32_t phoff;
+	uint32_t shoff;
+	uint32_t flags;
+	uint16_t ehsize;
+	uint16_t phentsize;
+	uint16_t phnum;
+	uint16_t shentsize;
+	uint16_t shnum;
+	uint16_t shstrndx;
+} elf32_ehdr_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t name;
+	uint32_t type;
+	uint32_t flags;
+	uint32_t addr;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t link;
+	uint32_t info;
+	uint32_t addralign;
+	uint32_t entsize;
+} elf32_shdr_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t name;
+	uint32_t value;
+	uint32_t size;
+	uint8_t info;
+	uint8_t other;
+	uint16_t shndx;
+} elf32_sym_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t dev_adr;
+	uint32_t sz_dev;
+	uint32_t sz_page;
+	uint32_t reserved;
+	uint8_t val_empty;
+	uint8_t pad[3];
+	uint32_t to_prog;
+	uint32_t to_erase;
+} flm_device_t;
+
+typedef struct
+{
+	FILE *fp;
+	elf32_ehdr_t ehdr;
+	elf32_shdr_t shstrtab;
+} flm_file_t;
+
+static int flm_read_at(FILE *fp, uint32_t offset, void *buf, uint32_t size)
+{
+	if (fseek(fp, offset, SEEK_SET) != 0)
+	{
+		return 0;
+	}
+
+	return fread(buf, 1, size, fp) == size;
+}
+
+static int flm_read_section(flm_file_t *flm, uint32_t index, elf32_shdr_t *shdr)
+{
+	if (index >= flm->ehdr.shnum)
+	{
+		return 0;
+	}
+
+	return flm_read_at(flm->fp, flm->ehdr.shoff + index * flm->ehdr.shentsize, shdr, sizeof(*shdr));
+}
+
+// Read a NUL terminated name of at most FLM_NAME_MAX - 1 characters from a string table
+static int flm_read_name(flm_file_t *flm, const elf32_shdr_t *strtab, uint32_t offset, char *name)
+{
+	uint32_t n;
+
+	if (offset >= strtab->size)
+	{
+		return 0;
+	}
+
+	n = strtab->size - offset;
+	if (n > FLM_NAME_MAX)
+	{
+		n = FLM_NAME_MAX;
+	}
+
+	memset(name, 0, FLM_NAME_MAX);
+	if (!flm_read_at(flm->fp, strtab->offset + offset, name, n))
+	{
+		return 0;
+	}
+
+	// Longer names never match, make sure they are not truncated into a match
+	return memchr(name, '\0', n) != NULL;
+}
+
+static dap_err_t flm_open(flm_file_t *flm, FILE *fp)
+{
+	flm->fp = fp;
+
+	if (!flm_read_at(fp, 0, &flm->ehdr, sizeof(flm->ehdr)))
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	if ((memcmp(flm->ehdr.ident, "\x7f" "ELF", 4) != 0) || (flm->ehdr.ident[4] != ELF_CLASS_32) ||
+		(flm->ehdr.ident[5] != ELF_DATA_LSB) || (flm->ehdr.machine != ELF_MACHINE_ARM) ||
+		(flm->ehdr.shentsize < sizeof(elf32_shdr_t)) || (flm->ehdr.shnum == 0))
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	if (!flm_read_section(flm, flm->ehdr.shstrndx, &flm->shstrtab))
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+static int flm_is_algo_section(flm_file_t *flm, const elf32_shdr_t *shdr)
+{
+	char name[FLM_NAME_MAX];
+
+	if (!(shdr->flags & ELF_SHF_ALLOC) || !flm_read_name(flm, &flm->shstrtab, shdr->name, name))
+	{
+		return 0;
+	}
+
+	return (strcmp(name, "PrgCode") == 0) || (strcmp(name, "PrgData") == 0);
+}
+
+// Copy PrgCode and PrgData to the blob at their link addresses, NOBITS stays zero
+static dap_err_t flm_load_blob(flm_file_t *flm, uint32_t ram_size, uint32_t **blob_out,
+							   uint32_t *blob_size, uint32_t *static_base)
+{
+	elf32_shdr_t shdr;
+	uint32_t *blob;
+	uint32_t size = 0;
+	uint32_t data = FLASH_ALGO_ENTRY_NONE;
+	uint32_t i;
+
+	for (i = 0; i < flm->ehdr.shnum; i++)
+	{
+		if (!flm_read_section(flm, i, &shdr))
+		{
+			return ERROR_ALGO_FILE;
+		}
+
+		if (!flm_is_algo_section(flm, &shdr))
+		{
+			continue;
+		}
+
+		if ((shdr.addr > ram_size) || (shdr.size > ram_size - shdr.addr))
+		{
+			return ERROR_ALGO_RAM;
+		}
+
+		if (shdr.addr + shdr.size > size)
+		{
+			size = shdr.addr + shdr.size;
+		}
+
+		// RW data starts at the first writable section after the code
+		if ((shdr.addr != 0) && (shdr.addr < data))
+		{
+			data = shdr.addr;
+		}
+	}
+
+	if (size == 0)
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	blob = flash_algo_alloc_blob(size);
+	if (blob == NULL)
+	{
+		return ERROR_INTERNAL;
+	}
+
+	for (i = 0; i < flm->ehdr.shnum; i++)
+	{
+		if (!flm_read_section(flm, i, &shdr))
+		{
+			free(blob);
+			return ERROR_ALGO_FILE;
+		}
+
+		if ((shdr.type == ELF_SHT_NOBITS) || !flm_is_algo_section(flm, &shdr))
+		{
+			continue;
+		}
+
+		if (!flm_read_at(flm->fp, shdr.offset, (uint8_t *)blob + FLASH_ALGO_HEADER_SIZE + shdr.addr, shdr.size))
+		{
+			free(blob);
+			return ERROR_ALGO_FILE;
+		}
+	}
+
+	*blob_out = blob;
+	*blob_size = size;
+	*static_base = (data == FLASH_ALGO_ENTRY_NONE) ? size : data;
+
+	return ERROR_SUCCESS;
+}
+
+// Resolve the algorithm entry points and the FlashDevice symbol
+static dap_err_t flm_load_symbols(flm_file_t *flm, flash_algo_entries_t *entries, elf32_sym_t *device)
+{
+	elf32_shdr_t symtab, strtab;
+	elf32_sym_t sym;
+	char name[FLM_NAME_MAX];
+	uint32_t i;
+
+	static const char *const names[] = {
+		"Init", "UnInit", "EraseChip", "EraseSector", "ProgramPage", "Verify",
+	};
+	uint32_t *const slots[] = {
+		&entries->init, &entries->uninit, &entries->erase_chip,
+		&entries->erase_sector, &entries->program_page, &entries->verify,
+	};
+
+	for (i = 0; i < flm->ehdr.shnum; i++)
+	{
+		if (!flm_read_section(flm, i, &symtab))
+		{
+			return ERROR_ALGO_FILE;
+		}
+
+		if (symtab.type == ELF_SHT_SYMTAB)
+		{
+			break;
+		}
+	}
+
+	if ((i == flm->ehdr.shnum) || (symtab.entsize < sizeof(elf32_sym_t)) ||
+		!flm_read_section(flm, symtab.link, &strtab))
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+	{
+		*slots[i] = FLASH_ALGO_ENTRY_NONE;
+	}
+	device->shndx = ELF_SHN_UNDEF;
+
+	for (i = 0; i < symtab.size / symtab.entsize; i++)
+	{
+		uint32_t j;
+
+		if (!flm_read_at(flm->fp, symtab.offset + i * symtab.entsize, &sym, sizeof(sym)))
+		{
+			return ERROR_ALGO_FILE;
+		}
+
+		if ((sym.shndx == ELF_SHN_UNDEF) || (sym.name == 0) || !flm_read_name(flm, &strtab, sym.name, name))
+		{
+			continue;
+		}
+
+		if (strcmp(name, "FlashDevice") == 0)
+		{
+			*device = sym;
+			continue;
+		}
+
+		for (j = 0; j < sizeof(names) / sizeof(names[0]); j++)
+		{
+			if (strcmp(name, names[j]) == 0)
+			{
+				*slots[j] = sym.value;
+				break;
+			}
+		}
+	}
+
+	if (device->shndx == ELF_SHN_UNDEF)
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+// Parse struct FlashDevice into the flash geometry and sector table
+static dap_err_t flm_load_device(flm_file_t *flm, const elf32_sym_t *device, flash_algo_t *algo)
+{
+	elf32_shdr_t shdr;
+	flm_device_t dev;
+	uint32_t sector[2];
+	uint32_t base;
+	uint32_t i;
+
+	if (!flm_read_section(flm, device->shndx, &shdr) || (device->value < shdr.addr) ||
+		(device->value - shdr.addr + FLM_DEV_SECTORS_OFFSET > shdr.size))
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	base = shdr.offset + device->value - shdr.addr;
+
+	if (!flm_read_at(flm->fp, base + FLM_DEV_ADR_OFFSET, &dev, sizeof(dev)))
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	algo->flash_start = dev.dev_adr;
+	algo->flash_size = dev.sz_dev;
+	algo->page_size = dev.sz_page;
+	algo->erased_value = dev.val_empty;
+	algo->sector_count = 0;
+
+	// Sectors are (size, offset from DevAdr) pairs ended by SECTOR_END
+	for (i = 0; ; i++)
+	{
+		if (!flm_read_at(flm->fp, base + FLM_DEV_SECTORS_OFFSET + i * sizeof(sector), &sector, sizeof(sector)))
+		{
+			return ERROR_ALGO_FILE;
+		}
+
+		if ((sector[0] == FLM_SECTOR_END) && (sector[1] == FLM_SECTOR_END))
+		{
+			break;
+		}
+
+		if (i == FLASH_ALGO_MAX_SECTORS)
+		{
+			return ERROR_ALGO_FILE;
+		}
+
+		algo->sectors[i].size = sector[0];
+		algo->sectors[i].start = dev.dev_adr + sector[1];
+
+		if ((algo->sectors[i].size == 0) || (i > 0 && algo->sectors[i].start <= algo->sectors[i - 1].start))
+		{
+			return ERROR_ALGO_FILE;
+		}
+	}
+
+	if ((i == 0) || (algo->flash_size == 0) || (algo->page_size == 0))
+	{
+		return ERROR_ALGO_FILE;
+	}
+
+	algo->sector_count = i;
+
+	return ERROR_SUCCESS;
+}
+
+dap_err_t flm_load(FILE *fp, uint32_t ram_start, uint32_t ram_size, flash_algo_t *algo)
+{
+	flm_file_t flm;
+	flash_algo_entries_t entries;
+	elf32_sym_t device;
+	uint32_t *blob;
+	uint32_t blob_size;
+	dap_err_t ret;
+
+	ret = flm_open(&flm, fp);
+	if (ret != ERROR_SUCCESS)
+	{
+		return ret;
+	}
+
+	ret = flm_load_symbols(&flm, &entries, &device);
+	if (ret != ERROR_SUCCESS)
+	{
+		return ret;
+	}
+
+	ret = flm_load_device(&flm, &device, algo);
+	if (ret != ERROR_SUCCESS)
+	{
+		return ret;
+	}
+
+	ret = flm_load_blob(&flm, ram_size, &blob, &blob_size, &entries.static_base);
+	if (ret != ERROR_SUCCESS)
+	{
+		return ret;
+	}
+
+	ret = flash_algo_place(algo, blob, blob_size, &entries, ram_start, ram_size);
+	if (ret != ERROR_SUCCESS)
+	{
+		free(blob);
+	}
+
+	return ret;
+}
@@ -0,0 +1,328 @@
+/**
+ * @file    spi_swd.c
+ * @brief   SWD transport shifted by the SPI peripheral
+ *
+ * A transaction can only send, then receive, so a transfer is split where
+ * SWDIO turns from input back to output:
+ *   1. idle cycles of the previous read + request (out), turnaround + ACK (in)
+ *   2. read:  RDATA + parity + turnaround (in)
+ *      write: turnaround (dummy), WDATA + parity + idle cycles (out)
+ * The idle cycles after a read are held back and sent in front of the next
+ * request, nothing else happens on the wire in between. SWCLK simply stops
+ * between transactions, which SWD allows at any point.
+ *
+ * SPI mode 0 shifts out on the falling edge, as the target samples on the
+ * rising one, but it also samples SWDIO on the rising edge, where the
+ * target changes it. Mode 1 would fix the read side and break the write
+ * side. The hold time comes from the GPIO matrix delaying SWCLK on the way
+ * out and SWDIO on the way in, plus the target's clock to output delay.
+ * SPI_SWD_MAX_CLOCK keeps the period long enough that these delays do not
+ * eat into the setup time as well.
+ */
+
+#include <string.h>
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "spi_swd.h"
+#include "swd_request.h"
+#include "driver/spi_master.h"
+
+#if (DAP_SPI_SWD != 0)
+
+#define SPI_SWD_HOST        SPI2_HOST
+#define SPI_SWD_MIN_CLOCK   1000000U    // Slower clocks use the bit-banged path
+#define SPI_SWD_MAX_CLOCK   10000000U   // Setup time through the GPIO matrix
+#define SPI_SWD_BUF_SIZE    40U         // WDATA + parity + up to 255 idle cycles
+
+static spi_device_handle_t spi_swd_dev;
+static uint8_t spi_swd_attached;
+static uint32_t spi_swd_clock = DAP_DEFAULT_SWJ_CLOCK;
+// Idle cycles owed by the last read, sent in front of the next request
+static uint32_t spi_swd_idle;
+
+static uint8_t spi_swd_add_device(void)
+{
+	spi_device_interface_config_t dev = {
+		.mode = 0, // Rising edge sampling, see the file header
+		.clock_speed_hz = (spi_swd_clock > SPI_SWD_MAX_CLOCK) ? SPI_SWD_MAX_CLOCK : spi_swd_clock,
+		.spics_io_num = -1,
+		.queue_size = 1,
+		.flags = SPI_DEVICE_3WIRE | SPI_DEVICE_HALFDUPLEX | SPI_DEVICE_BIT_LSBFIRST,
+	};
+
+	if (spi_bus_add_device(SPI_SWD_HOST, &dev, &spi_swd_dev) != ESP_OK)
+	{
+		return 0;
+	}
+
+	// Keep the bus so that polling transactions skip the bus lock
+	if (spi_device_acquire_bus(spi_swd_dev, portMAX_DELAY) != ESP_OK)
+	{
+		spi_bus_remove_device(spi_swd_dev);
+		return 0;
+	}
+
+	return 1;
+}
+
+static void spi_swd_remove_device(void)
+{
+	spi_device_release_bus(spi_swd_dev);
+	spi_bus_remove_device(spi_swd_dev);
+}
+
+// Run one half duplex transaction: tx_bits out, dummy_bits undriven, rx_bits in
+static void spi_swd_xfer(const uint8_t *tx, uint32_t tx_bits, uint32_t dummy_bits, uint8_t *rx, uint32_t rx_bits)
+{
+	spi_transaction_ext_t t;
+
+	memset(&t, 0, sizeof(t));
+	t.base.flags = SPI_TRANS_VARIABLE_DUMMY;
+	t.dummy_bits = dummy_bits;
+	t.base.length = tx_bits;
+	t.base.tx_buffer = tx_bits ? tx : NULL;
+	t.base.rxlength = rx_bits;
+	t.base.rx_buffer = rx_bits ? rx : NULL;
+
+	spi_device_polling_transmit(spi_swd_dev, &t.base);
+}
+
+// Clock out idle cycles still owed before anything else uses the pins
+static void spi_swd_flush(void)
+{
+	uint8_t tx[SPI_SWD_BUF_SIZE];
+
+	if (spi_swd_idle == 0U)
+	{
+		return;
+	}
+
+	memset(tx, 0, sizeof(tx));
+	spi_swd_xfer(tx, spi_swd_idle, 0, NULL, 0);
+	spi_swd_idle = 0U;
+}
+
+static uint64_t spi_swd_le64(const uint8_t *buf)
+{
+	uint64_t val = 0;
+	int i;
+
+	for (i = 7; i >= 0; i--)
+	{
+		val = (val << 8) | buf[i];
+	}
+
+	return val;
+}
+
+uint8_t spi_swd_init(void)
+{
+	spi_bus_config_t bus = {
+		.mosi_io_num = PIN_SWDIO,
+		.miso_io_num = -1,
+		.sclk_io_num = PIN_SWCLK,
+		.quadwp_io_num = -1,
+		.quadhd_io_num = -1,
+		.max_transfer_sz = SPI_SWD_BUF_SIZE,
+	};
+
+	if (spi_swd_attached)
+	{
+		return 1;
+	}
+
+	if (spi_swd_clock < SPI_SWD_MIN_CLOCK)
+	{
+		return 0;
+	}
+
+	if (spi_bus_initialize(SPI_SWD_HOST, &bus, SPI_DMA_DISABLED) != ESP_OK)
+	{
+		return 0;
+	}
+
+	if (!spi_swd_add_device())
+	{
+		spi_bus_free(SPI_SWD_HOST);
+		return 0;
+	}
+
+	spi_swd_attached = 1;
+	return 1;
+}
+
+void spi_swd_deinit(void)
+{
+	if (!spi_swd_attached)
+	{
+		return;
+	}
+
+	spi_swd_flush();
+	spi_swd_attached = 0;
+	spi_swd_remove_device();
+	spi_bus_free(SPI_SWD_HOST);
+}
+
+uint8_t spi_swd_active(void)
+{
+	return spi_swd_attached;
+}
+
+void spi_swd_set_clock(uint32_t clock)
+{
+	spi_swd_clock = clock;
+
+	if (!spi_swd_attached)
+	{
+		// Switch from the bit-banged path once the clock allows it
+		if (DAP_Data.debug_port == DAP_PORT_SWD)
+		{
+			spi_swd_init();
+		}
+		return;
+	}
+
+	spi_swd_flush();
+	spi_swd_remove_device();
+
+	if ((clock < SPI_SWD_MIN_CLOCK) || !spi_swd_add_device())
+	{
+		// Fall back to the bit-banged path
+		spi_swd_attached = 0;
+		spi_bus_free(SPI_SWD_HOST);
+		PORT_SWD_SETUP();
+	}
+}
+
+uint32_t spi_swd_get_clock(void)
+{
+	int freq_khz;
+
+	if (!spi_swd_attached || spi_device_get_actual_freq(spi_swd_dev, &freq_khz) != ESP_OK)
+	{
+		return 0;
+	}
+
+	return (uint32_t)freq_khz * 1000U;
+}
+
+void spi_swd_sequence_write(uint32_t count, const uint8_t *data)
+{
+	uint32_t n;
+
+	spi_swd_flush();
+	while (count)
+	{
+		n = (count > SPI_SWD_BUF_SIZE * 8U) ? SPI_SWD_BUF_SIZE * 8U : count;
+		spi_swd_xfer(data, n, 0, NULL, 0);
+		data += n / 8U;
+		count -= n;
+	}
+}
+
+void spi_swd_sequence_read(uint32_t count, uint8_t *data)
+{
+	uint8_t rx[SPI_SWD_BUF_SIZE];
+	uint32_t n;
+
+	spi_swd_flush();
+	while (count)
+	{
+		n = (count > SPI_SWD_BUF_SIZE * 8U) ? SPI_SWD_BUF_SIZE * 8U : count;
+		spi_swd_xfer(NULL, 0, 0, rx, n);
+		memcpy(data, rx, (n + 7U) / 8U);
+		data += n / 8U;
+		count -= n;
+	}
+}
+
+uint8_t spi_swd_transfer(uint32_t request, uint32_t *data)
+{
+	uint8_t tx[SPI_SWD_BUF_SIZE];
+	uint8_t rx[8] = {0};
+	uint32_t turnaround = DAP_Data.swd_conf.turnaround;
+	uint32_t idle = DAP_Data.transfer.idle_cycles;
+	uint32_t ack, val, pos, hdr;
+	uint64_t in;
+
+	// Owed idle cycles (zero bits), then the packet request:
+	// start, APnDP, RnW, A[3:2], parity, stop, park
+	memset(tx, 0, sizeof(tx));
+	pos = spi_swd_idle;
+	hdr = SWD_RequestHeader[request & 0x0FU];
+	tx[pos / 8U] |= (uint8_t)(hdr << (pos % 8U));
+	tx[pos / 8U + 1U] |= (uint8_t)(hdr >> (8U - (pos % 8U)));
+	spi_swd_idle = 0U;
+	spi_swd_xfer(tx, pos + 8U, 0, rx, turnaround + 3U);
+	ack = (uint32_t)(spi_swd_le64(rx) >> turnaround) & 0x07U;
+	memset(tx, 0, sizeof(tx));
+
+	if (ack == DAP_TRANSFER_OK)
+	{
+		if (request & DAP_TRANSFER_RnW)
+		{
+			// Read data, parity and turnaround, the idle cycles go with the next request
+			memset(rx, 0, sizeof(rx));
+			spi_swd_xfer(NULL, 0, 0, rx, 33U + turnaround);
+			in = spi_swd_le64(rx);
+			val = (uint32_t)in;
+			if (SWD_Parity(val) ^ ((uint32_t)(in >> 32) & 1U))
+			{
+				ack = DAP_TRANSFER_ERROR;
+			}
+			if (data)
+			{
+				*data = val;
+			}
+			spi_swd_idle = idle;
+		}
+		else
+		{
+			// Turnaround, write data and parity, idle cycles as zero bits behind
+			val = *data;
+			tx[0] = (uint8_t)(val >> 0);
+			tx[1] = (uint8_t)(val >> 8);
+			tx[2] = (uint8_t)(val >> 16);
+			tx[3] = (uint8_t)(val >> 24);
+			tx[4] = (uint8_t)SWD_Parity(val);
+			spi_swd_xfer(tx, 33U + idle, turnaround, NULL, 0);
+		}
+
+		// Capture Timestamp
+		if (request & DAP_TRANSFER_TIMESTAMP)
+		{
+			DAP_Data.timestamp = TIMESTAMP_GET();
+		}
+
+		return (uint8_t)ack;
+	}
+
+	if ((ack == DAP_TRANSFER_WAIT) || (ack == DAP_TRANSFER_FAULT))
+	{
+		if (DAP_Data.swd_conf.data_phase && ((request & DAP_TRANSFER_RnW) != 0U))
+		{
+			// Dummy read RDATA[0:31] + parity, then turnaround
+			spi_swd_xfer(NULL, 0, 0, rx, 33U + turnaround);
+		}
+		else if (DAP_Data.swd_conf.data_phase)
+		{
+			// Turnaround, then dummy write WDATA[0:31] + parity
+			spi_swd_xfer(tx, 33U, turnaround, NULL, 0);
+		}
+		else
+		{
+			spi_swd_xfer(NULL, 0, 0, rx, turnaround);
+		}
+
+		return (uint8_t)ack;
+	}
+
+	// Protocol error, back off data phase
+	spi_swd_xfer(NULL, 0, 0, rx, turnaround + 33U);
+
+	return (uint8_t)ack;
+}
+
+#endif /* (DAP_SPI_SWD != 0) */
@@ -32,6 +32,9 @@ extern uint32_t Flash_Page_Size;
 #define MAX_SWD_RETRY 100
 #define MAX_TIMEOUT 100000 // Timeout for syscalls on target
 
+#define SWD_PROBE_MIN_CLOCK 100000 // Slowest clock tried by swd_probe_clock()
+#define SWD_PROBE_ROUNDS 8         // Back to back DP accesses that must all pass
+
 //! This can vary from target to target and should be in the structure or flash blob
 #define TARGET_AUTO_INCREMENT_PAGE_SIZE    (1024)
 
@@ -49,6 +52,15 @@ typedef struct
 
 static DAP_STATE dap_state;
 
+// SWCLK used by swd_init_debug(), the upper bound when swd_clock_probe is set.
+// 0 leaves the clock the debug host set with DAP_SWJ_Clock alone.
+static uint32_t swd_clock;
+static uint8_t swd_clock_probe;
+// Host clock to put back once the override is cleared
+static uint32_t swd_host_clock;
+// Result of the last probe, 0 until the target has been probed
+static uint32_t swd_probed_clock;
+
 static uint8_t swd_read_core_register(uint32_t n, uint32_t *val);
 static uint8_t swd_write_core_register(uint32_t n, uint32_t val);
 
@@ -89,6 +101,39 @@ static uint8_t swd_transfer_retry(uint32_t req, uint32_t *data)
 	return ack;
 }
 
+#if CONFIG_PROGRAMMER_SWD_BENCHMARK
+static uint8_t swd_block_per_word; // Benchmark baseline, one swd_transfer_retry() per word
+
+void swd_set_block_per_word(uint8_t enable)
+{
+	swd_block_per_word = enable;
+}
+#endif
+
+// DRW phase of a block transfer, count words to/from the same register.
+// SWD_TransferBlock() splits it into bursts short enough for the interrupt watchdog.
+static uint8_t swd_transfer_block(uint32_t req, uint32_t *data, uint32_t count)
+{
+#if CONFIG_PROGRAMMER_SWD_BENCHMARK
+	uint8_t ack;
+
+	if (swd_block_per_word)
+	{
+		for (; count > 0; count--, data++)
+		{
+			ack = swd_transfer_retry(req, data);
+			if (ack != DAP_TRANSFER_OK)
+			{
+				return ack;
+			}
+		}
+		return DAP_TRANSFER_OK;
+	}
+#endif
+
+	return SWD_TransferBlock(req, data, count, MAX_SWD_RETRY);
+}
+
 uint8_t swd_init(void)
 {
 	DAP_Setup();
@@ -236,7 +281,7 @@ static uint8_t swd_write_block(uint32_t address, uint8_t *data, uint32_t size)
 {
 	uint8_t tmp_in[4], req;
 	uint32_t size_in_words;
-	uint32_t i, ack;
+	uint32_t ack;
 
 	if (size == 0)
 	{
@@ -260,17 +305,12 @@ static uint8_t swd_write_block(uint32_t address, uint8_t *data, uint32_t size)
 		return 0;
 	}
 
-	// DRW write
+	// DRW write, the whole auto-increment page in one go
 	req = SWD_REG_AP | SWD_REG_W | (3 << 2);
 
-	for (i = 0; i < size_in_words; i++)
+	if (swd_transfer_block(req, (uint32_t *)data, size_in_words) != 0x01)
 	{
-		if (swd_transfer_retry(req, (uint32_t *)data) != 0x01)
-		{
-			return 0;
-		}
-
-		data += 4;
+		return 0;
 	}
 
 	// dummy read
@@ -285,7 +325,6 @@ static uint8_t swd_read_block(uint32_t address, uint8_t *data, uint32_t size)
 {
 	uint8_t tmp_in[4], req, ack;
 	uint32_t size_in_words;
-	uint32_t i;
 
 	if (size == 0)
 	{
@@ -317,16 +356,13 @@ static uint8_t swd_read_block(uint32_t address, uint8_t *data, uint32_t size)
 		return 0;
 	}
 
-	for (i = 0; i < (size_in_words - 1); i++)
+	if (swd_transfer_block(req, (uint32_t *)data, size_in_words - 1) != DAP_TRANSFER_OK)
 	{
-		if (swd_transfer_retry(req, (uint32_t *)data) != DAP_TRANSFER_OK)
-		{
-			return 0;
-		}
-
-		data += 4;
+		return 0;
 	}
 
+	data += (size_in_words - 1) * 4;
+
 	// read last word
 	req = SWD_REG_DP | SWD_REG_R | SWD_REG_ADR(DP_RDBUFF);
 	ack = swd_transfer_retry(req, (uint32_t *)data);
@@ -400,7 +436,7 @@ static uint8_t swd_write_data(uint32_t address, uint32_t data)
 }
 
 // Read 32-bit word from target memory.
-static uint8_t swd_read_word(uint32_t addr, uint32_t *val)
+uint8_t swd_read_word(uint32_t addr, uint32_t *val)
 {
 	if (!swd_write_ap(AP_CSW, CSW_VALUE | CSW_SIZE32))
 	{
@@ -470,6 +506,12 @@ static uint8_t swd_write_byte(uint32_t addr, uint8_t val)
 	return 1;
 }
 
+void swd_forget_state(void)
+{
+	dap_state.select = 0xffffffff;
+	dap_state.csw = 0xffffffff;
+}
+
 // Read unaligned data from target memory.
 // size is in bytes.
 uint8_t swd_read_memory(uint32_t address, uint8_t *data, uint32_t size)
@@ -715,10 +757,10 @@ static uint8_t swd_wait_until_halted(void)
 	return 0;
 }
 
-uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4)
+uint8_t swd_flash_syscall_start(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4)
 {
 	DEBUG_STATE state = {{0}, 0};
-	// Call flash algorithm function on target and wait for result.
+	// Call flash algorithm function on target, do not wait for it.
 	state.r[0] = arg1;						   // R0: Argument 1
 	state.r[1] = arg2;						   // R1: Argument 2
 	state.r[2] = arg3;						   // R2: Argument 3
@@ -729,30 +771,81 @@ uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t e
 	state.r[15] = entry;					   // PC: Entry Point
 	state.xpsr = 0x01000000;				   // xPSR: T = 1, ISR = 0
 
-	if (!swd_write_debug_state(&state))
+	return swd_write_debug_state(&state);
+}
+
+uint8_t swd_flash_syscall_done(uint8_t *done)
+{
+	uint32_t val;
+
+	if (!swd_read_word(DBG_HCSR, &val))
 	{
 		return 0;
 	}
 
+	*done = (val & S_HALT) ? 1 : 0;
+	return 1;
+}
+
+static uint8_t swd_flash_syscall_finish(uint32_t *r0)
+{
 	if (!swd_wait_until_halted())
 	{
 		return 0;
 	}
 
-	if (!swd_read_core_register(0, &state.r[0]))
+	return swd_read_core_register(0, r0);
+}
+
+uint8_t swd_flash_syscall_wait(uint32_t arg1, uint32_t arg2, flash_algo_return_t return_type)
+{
+	uint32_t r0;
+
+	if (!swd_flash_syscall_finish(&r0))
 	{
 		return 0;
 	}
 
-	// Flash functions return 0 if successful.
-	if (state.r[0] != 0)
+	if (return_type == FLASHALGO_RETURN_POINTER)
 	{
-		return 0;
+		// Flash verify functions return pointer to byte following the buffer if successful.
+		if (r0 != (arg1 + arg2))
+		{
+			return 0;
+		}
+	}
+	else
+	{
+		// Flash functions return 0 if successful.
+		if (r0 != 0)
+		{
+			return 0;
+		}
 	}
 
 	return 1;
 }
 
+uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, flash_algo_return_t return_type)
+{
+	if (!swd_flash_syscall_start(sysCallParam, entry, arg1, arg2, arg3, arg4))
+	{
+		return 0;
+	}
+
+	return swd_flash_syscall_wait(arg1, arg2, return_type);
+}
+
+uint8_t swd_flash_syscall_call(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, uint32_t *result)
+{
+	if (!swd_flash_syscall_start(sysCallParam, entry, arg1, arg2, arg3, arg4))
+	{
+		return 0;
+	}
+
+	return swd_flash_syscall_finish(result);
+}
+
 // SWD Reset
 static uint8_t swd_reset(void)
 {
@@ -822,6 +915,66 @@ static uint8_t JTAG2SWD()
 	return 1;
 }
 
+static void swd_apply_clock(uint32_t clock)
+{
+	DAP_Data.nominal_clock = clock;
+	Set_DAP_Clock_Delay(clock);
+}
+
+uint32_t swd_probe_clock(uint32_t max_clock)
+{
+	uint32_t clock, id, ref;
+	int i;
+
+	for (clock = max_clock; clock >= SWD_PROBE_MIN_CLOCK; clock /= 2)
+	{
+		swd_apply_clock(clock);
+
+		if (!JTAG2SWD() || !swd_read_dp(DP_IDCODE, &ref))
+		{
+			continue;
+		}
+
+		// Writes and reads both have to survive, the IDCODE must not change
+		for (i = 0; i < SWD_PROBE_ROUNDS; i++)
+		{
+			if (!swd_write_dp(DP_ABORT, 0) || !swd_read_dp(DP_IDCODE, &id) || id != ref)
+			{
+				break;
+			}
+		}
+
+		if (i == SWD_PROBE_ROUNDS)
+		{
+			return clock;
+		}
+	}
+
+	swd_apply_clock(SWD_PROBE_MIN_CLOCK);
+	return 0;
+}
+
+void swd_set_clock(uint32_t clock, uint8_t probe)
+{
+	if (clock != 0 && swd_clock == 0)
+	{
+		swd_host_clock = DAP_Data.nominal_clock;
+	}
+	else if (clock == 0 && swd_clock != 0)
+	{
+		swd_apply_clock(swd_host_clock);
+	}
+
+	swd_clock = clock;
+	swd_clock_probe = probe;
+	swd_probed_clock = 0;
+}
+
+uint32_t swd_get_clock(void)
+{
+	return DAP_GetClock();
+}
+
 uint8_t swd_init_debug(void)
 {
 	uint32_t tmp = 0;
@@ -832,6 +985,20 @@ uint8_t swd_init_debug(void)
 	dap_state.csw = 0xffffffff;
 	swd_init();
 
+	// Without an override the host's SWJ_Clock is kept
+	if (swd_clock != 0 && swd_clock_probe && swd_probed_clock == 0)
+	{
+		swd_probed_clock = swd_probe_clock(swd_clock);
+		if (swd_probed_clock == 0)
+		{
+			return 0;
+		}
+	}
+	else if (swd_clock != 0)
+	{
+		swd_apply_clock(swd_clock_probe ? swd_probed_clock : swd_clock);
+	}
+
 	// call a target dependant function
 	// this function can do several stuff before really initing the debug
 	// target_before_init_debug();
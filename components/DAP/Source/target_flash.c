@@ -0,0 +1,286 @@
+/**
+ * @file    target_flash.c
+ * @brief   Drive a flash algorithm on the target through swd_host
+ */
+
+#include <string.h>
+
+#include "target_flash.h"
+#include "swd_host.h"
+
+// Chunk size of the SWD read-back compare
+#define VERIFY_CHUNK_SIZE 256
+
+dap_err_t target_flash_init(const flash_algo_t *algo)
+{
+	const program_target_t *target = &algo->target;
+
+	if (!swd_set_target_state_hw(RESET_PROGRAM))
+	{
+		return ERROR_RESET;
+	}
+
+	if (!swd_write_memory(target->algo_start, (uint8_t *)target->algo_blob, target->algo_size))
+	{
+		return ERROR_ALGO_DL;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+dap_err_t target_flash_uninit(void)
+{
+	if (!swd_set_target_state_hw(RESET_RUN))
+	{
+		return ERROR_RESET;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+dap_err_t target_flash_func_init(const flash_algo_t *algo, uint32_t function)
+{
+	const program_target_t *target = &algo->target;
+
+	if (!swd_flash_syscall_exec(&target->sys_call_s, target->init, algo->flash_start, 0, function, 0,
+								FLASHALGO_RETURN_BOOL))
+	{
+		return ERROR_INIT;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+dap_err_t target_flash_func_uninit(const flash_algo_t *algo, uint32_t function)
+{
+	const program_target_t *target = &algo->target;
+
+	if (!swd_flash_syscall_exec(&target->sys_call_s, target->uninit, function, 0, 0, 0,
+								FLASHALGO_RETURN_BOOL))
+	{
+		return ERROR_UNINIT;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+dap_err_t target_flash_erase_sector(const flash_algo_t *algo, uint32_t addr)
+{
+	const program_target_t *target = &algo->target;
+
+	if (!swd_flash_syscall_exec(&target->sys_call_s, target->erase_sector, addr, 0, 0, 0,
+								FLASHALGO_RETURN_BOOL))
+	{
+		return ERROR_ERASE_SECTOR;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+dap_err_t target_flash_erase_chip(const flash_algo_t *algo)
+{
+	const program_target_t *target = &algo->target;
+
+	if (target->erase_chip == 0)
+	{
+		return ERROR_ALGO_MISSING;
+	}
+
+	if (!swd_flash_syscall_exec(&target->sys_call_s, target->erase_chip, 0, 0, 0, 0,
+								FLASHALGO_RETURN_BOOL))
+	{
+		return ERROR_ERASE_ALL;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+dap_err_t target_flash_program_page(const flash_algo_t *algo, uint32_t addr, const uint8_t *buf, uint32_t size)
+{
+	const program_target_t *target = &algo->target;
+
+	if (size > target->program_buffer_size)
+	{
+		return ERROR_INTERNAL;
+	}
+
+	if (!swd_write_memory(target->program_buffer, (uint8_t *)buf, size))
+	{
+		return ERROR_ALGO_DATA_SEQ;
+	}
+
+	if (!swd_flash_syscall_exec(&target->sys_call_s, target->program_page, addr, size, target->program_buffer, 0,
+								FLASHALGO_RETURN_BOOL))
+	{
+		return ERROR_WRITE;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+void target_flash_pipe_init(target_flash_pipe_t *pipe, const flash_algo_t *algo)
+{
+	memset(pipe, 0, sizeof(*pipe));
+	pipe->algo = algo;
+}
+
+dap_err_t target_flash_pipe_flush(target_flash_pipe_t *pipe)
+{
+	if (!pipe->busy)
+	{
+		return ERROR_SUCCESS;
+	}
+
+	pipe->busy = 0;
+
+	if (!swd_flash_syscall_wait(pipe->addr, pipe->size, FLASHALGO_RETURN_BOOL))
+	{
+		return ERROR_WRITE;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+dap_err_t target_flash_pipe_program(target_flash_pipe_t *pipe, uint32_t addr, const uint8_t *buf, uint32_t size)
+{
+	const program_target_t *target = &pipe->algo->target;
+	uint32_t buffer;
+	dap_err_t ret;
+
+	if (size > target->program_buffer_size)
+	{
+		return ERROR_INTERNAL;
+	}
+
+	// With a single buffer the previous page must be done before it is overwritten
+	if (pipe->algo->program_buffer_count < 2)
+	{
+		ret = target_flash_pipe_flush(pipe);
+		if (ret != ERROR_SUCCESS)
+		{
+			return ret;
+		}
+	}
+
+	buffer = target->program_buffer + pipe->slot * target->program_buffer_size;
+
+	if (!swd_write_memory(buffer, (uint8_t *)buf, size))
+	{
+		return ERROR_ALGO_DATA_SEQ;
+	}
+
+	ret = target_flash_pipe_flush(pipe);
+	if (ret != ERROR_SUCCESS)
+	{
+		return ret;
+	}
+
+	if (!swd_flash_syscall_start(&target->sys_call_s, target->program_page, addr, size, buffer, 0))
+	{
+		return ERROR_WRITE;
+	}
+
+	pipe->addr = addr;
+	pipe->size = size;
+	pipe->busy = 1;
+	pipe->slot = (pipe->slot + 1) % pipe->algo->program_buffer_count;
+
+	return ERROR_SUCCESS;
+}
+
+dap_err_t target_flash_verify(const flash_algo_t *algo, uint32_t addr, const uint8_t *buf, uint32_t size)
+{
+	const program_target_t *target = &algo->target;
+	uint8_t chunk[VERIFY_CHUNK_SIZE];
+	uint32_t n;
+
+	if (target->verify != 0 && size <= target->program_buffer_size)
+	{
+		if (!swd_write_memory(target->program_buffer, (uint8_t *)buf, size))
+		{
+			return ERROR_ALGO_DATA_SEQ;
+		}
+
+		if (!swd_flash_syscall_exec(&target->sys_call_s, target->verify, addr, size, target->program_buffer, 0,
+									FLASHALGO_RETURN_POINTER))
+		{
+			return ERROR_WRITE_VERIFY;
+		}
+
+		return ERROR_SUCCESS;
+	}
+
+	while (size > 0)
+	{
+		n = (size > sizeof(chunk)) ? sizeof(chunk) : size;
+
+		if (!swd_read_memory(addr, chunk, n))
+		{
+			return ERROR_WRITE_VERIFY;
+		}
+
+		if (memcmp(chunk, buf, n) != 0)
+		{
+			return ERROR_WRITE_VERIFY;
+		}
+
+		addr += n;
+		buf += n;
+		size -= n;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+dap_err_t target_flash_crc32(const flash_algo_t *algo, uint32_t addr, uint32_t size, uint32_t *crc)
+{
+	if (algo->crc32 == 0)
+	{
+		return ERROR_ALGO_MISSING;
+	}
+
+	if (!swd_flash_syscall_call(&algo->target.sys_call_s, algo->crc32, addr, size, 0, 0, crc))
+	{
+		return ERROR_FAILURE;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+dap_err_t target_flash_verify_crc32(const flash_algo_t *algo, uint32_t addr, uint32_t size, uint32_t crc)
+{
+	uint32_t result;
+	dap_err_t ret;
+
+	ret = target_flash_crc32(algo, addr, size, &result);
+	if (ret != ERROR_SUCCESS)
+	{
+		return (ret == ERROR_FAILURE) ? ERROR_WRITE_VERIFY : ret;
+	}
+
+	if (result != crc)
+	{
+		return ERROR_WRITE_VERIFY;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+dap_err_t target_flash_blank_check(const flash_algo_t *algo, uint32_t addr, uint32_t size, uint8_t *blank)
+{
+	uint32_t result;
+
+	if (algo->blank_check == 0)
+	{
+		return ERROR_ALGO_MISSING;
+	}
+
+	if (!swd_flash_syscall_call(&algo->target.sys_call_s, algo->blank_check, addr, size,
+								algo->erased_value * 0x01010101U, 0, &result))
+	{
+		return ERROR_FAILURE;
+	}
+
+	*blank = (result == 0);
+	return ERROR_SUCCESS;
+}
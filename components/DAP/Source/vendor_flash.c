@@ -0,0 +1,632 @@
+/**
+ * @file    vendor_flash.c
+ * @brief   Flash programming vendor commands for host tools
+ *
+ * Runs in the DAP command context, the erase and program operations are left
+ * running on the target between commands and completed by later commands.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DAP_config.h"
+#include "DAP.h"
+#include "swd_host.h"
+#include "flash_algo.h"
+#include "target_flash.h"
+#include "vendor_flash.h"
+
+typedef struct
+{
+	uint8_t *file;              // Uploaded algorithm file
+	uint32_t file_size;
+	uint32_t file_cap;
+
+	flash_algo_t algo;
+	uint8_t ready;              // Algorithm downloaded to the target
+	uint32_t function;          // Function code the algorithm is initialized for, 0 if none
+	dap_err_t error;            // First error since FlashInit, later commands fail with it
+	uint32_t done;              // Bytes erased or programmed by the current operation
+
+	uint8_t erasing;            // Erase running on the target
+	uint8_t erase_chip;
+	uint32_t erase_addr;        // Next sector to erase
+	uint32_t erase_end;
+	uint32_t erase_size;        // Size of the sector being erased
+
+	target_flash_pipe_t pipe;
+	uint8_t *page;              // Page being assembled from FlashProgram data
+	uint32_t page_addr;
+	uint32_t page_fill;         // Offset behind the last byte written to the page
+	uint8_t page_open;
+} vendor_flash_t;
+
+static vendor_flash_t vendor_flash;
+
+static uint32_t vendor_flash_u32(const uint8_t *p)
+{
+	return (uint32_t)(*(p+0) <<  0) |
+	       (uint32_t)(*(p+1) <<  8) |
+	       (uint32_t)(*(p+2) << 16) |
+	       (uint32_t)(*(p+3) << 24);
+}
+
+static void vendor_flash_put_u32(uint8_t *p, uint32_t val)
+{
+	*(p+0) = (uint8_t)(val >>  0);
+	*(p+1) = (uint8_t)(val >>  8);
+	*(p+2) = (uint8_t)(val >> 16);
+	*(p+3) = (uint8_t)(val >> 24);
+}
+
+// Write status and error, return the response length
+static uint32_t vendor_flash_response(uint8_t *response, dap_err_t error)
+{
+	*(response+0) = (error == ERROR_SUCCESS) ? DAP_OK : DAP_ERROR;
+	*(response+1) = (uint8_t)error;
+	return 2U;
+}
+
+static dap_err_t vendor_flash_fail(dap_err_t error)
+{
+	if (vendor_flash.error == ERROR_SUCCESS)
+	{
+		vendor_flash.error = error;
+	}
+	return error;
+}
+
+static void vendor_flash_release(void)
+{
+	flash_algo_free(&vendor_flash.algo);
+	free(vendor_flash.page);
+	vendor_flash.page = NULL;
+	vendor_flash.ready = 0;
+	vendor_flash.function = 0;
+	vendor_flash.erasing = 0;
+	vendor_flash.page_open = 0;
+}
+
+// Common checks of the commands that drive the algorithm
+static dap_err_t vendor_flash_begin(void)
+{
+	if (!vendor_flash.ready || DAP_Data.debug_port != DAP_PORT_SWD)
+	{
+		return ERROR_ALGO_MISSING;
+	}
+
+	if (vendor_flash.error != ERROR_SUCCESS)
+	{
+		return vendor_flash.error;
+	}
+
+	swd_forget_state();
+	return ERROR_SUCCESS;
+}
+
+// Initialize the algorithm for function, uninitializing the previous one
+static dap_err_t vendor_flash_select(uint32_t function)
+{
+	dap_err_t ret;
+
+	if (vendor_flash.function == function)
+	{
+		return ERROR_SUCCESS;
+	}
+
+	if (vendor_flash.function != 0)
+	{
+		ret = target_flash_func_uninit(&vendor_flash.algo, vendor_flash.function);
+		vendor_flash.function = 0;
+		if (ret != ERROR_SUCCESS)
+		{
+			return ret;
+		}
+	}
+
+	ret = target_flash_func_init(&vendor_flash.algo, function);
+	if (ret == ERROR_SUCCESS)
+	{
+		vendor_flash.function = function;
+	}
+
+	return ret;
+}
+
+// Start erasing the next sector of the range, clear erasing when it is done
+static dap_err_t vendor_flash_erase_next(void)
+{
+	const program_target_t *target = &vendor_flash.algo.target;
+	uint32_t sector;
+
+	if (vendor_flash.erase_addr >= vendor_flash.erase_end)
+	{
+		vendor_flash.erasing = 0;
+		return ERROR_SUCCESS;
+	}
+
+	sector = flash_algo_sector(&vendor_flash.algo, vendor_flash.erase_addr, &vendor_flash.erase_size);
+	if (vendor_flash.erase_size == 0)
+	{
+		vendor_flash.erasing = 0;
+		return ERROR_IMAGE_BOUNDS;
+	}
+
+	if (!swd_flash_syscall_start(&target->sys_call_s, target->erase_sector, sector, 0, 0, 0))
+	{
+		vendor_flash.erasing = 0;
+		return ERROR_ERASE_SECTOR;
+	}
+
+	vendor_flash.erase_addr = sector + vendor_flash.erase_size;
+	return ERROR_SUCCESS;
+}
+
+// Advance the running erase, with wait set until it has finished
+static dap_err_t vendor_flash_erase_poll(uint8_t wait)
+{
+	uint8_t done;
+	dap_err_t ret;
+
+	while (vendor_flash.erasing)
+	{
+		if (!wait)
+		{
+			if (!swd_flash_syscall_done(&done))
+			{
+				vendor_flash.erasing = 0;
+				return ERROR_ERASE_SECTOR;
+			}
+			if (!done)
+			{
+				return ERROR_SUCCESS;
+			}
+		}
+
+		if (!swd_flash_syscall_wait(0, 0, FLASHALGO_RETURN_BOOL))
+		{
+			vendor_flash.erasing = 0;
+			return vendor_flash.erase_chip ? ERROR_ERASE_ALL : ERROR_ERASE_SECTOR;
+		}
+
+		if (vendor_flash.erase_chip)
+		{
+			vendor_flash.done = vendor_flash.algo.flash_size;
+			vendor_flash.erasing = 0;
+			return ERROR_SUCCESS;
+		}
+
+		vendor_flash.done += vendor_flash.erase_size;
+
+		ret = vendor_flash_erase_next();
+		if (ret != ERROR_SUCCESS)
+		{
+			return ret;
+		}
+	}
+
+	return ERROR_SUCCESS;
+}
+
+// Collect the result of the page being programmed, with wait set until it has finished
+static dap_err_t vendor_flash_program_poll(uint8_t wait)
+{
+	uint8_t done;
+
+	if (!vendor_flash.pipe.busy)
+	{
+		return ERROR_SUCCESS;
+	}
+
+	if (!wait)
+	{
+		if (!swd_flash_syscall_done(&done))
+		{
+			vendor_flash.pipe.busy = 0;
+			return ERROR_WRITE;
+		}
+		if (!done)
+		{
+			return ERROR_SUCCESS;
+		}
+	}
+
+	return target_flash_pipe_flush(&vendor_flash.pipe);
+}
+
+// Upload the assembled page and start programming it, the page buffer is free on return
+static dap_err_t vendor_flash_write_page(void)
+{
+	dap_err_t ret;
+
+	vendor_flash.page_open = 0;
+
+	ret = target_flash_pipe_program(&vendor_flash.pipe, vendor_flash.page_addr, vendor_flash.page,
+									vendor_flash.algo.page_size);
+	if (ret == ERROR_SUCCESS)
+	{
+		vendor_flash.done += vendor_flash.page_fill;
+	}
+
+	return ret;
+}
+
+// Finish all pending work: the rest of the erase, the partial page and the last ProgramPage
+static dap_err_t vendor_flash_sync(void)
+{
+	dap_err_t ret;
+
+	ret = vendor_flash_erase_poll(1);
+	if (ret != ERROR_SUCCESS)
+	{
+		return ret;
+	}
+
+	if (vendor_flash.page_open)
+	{
+		ret = vendor_flash_write_page();
+		if (ret != ERROR_SUCCESS)
+		{
+			return ret;
+		}
+	}
+
+	return vendor_flash_program_poll(1);
+}
+
+uint32_t DAP_VendorFlashLoad(const uint8_t *request, uint8_t *response)
+{
+	uint32_t offset;
+	uint32_t size;
+	uint32_t cap;
+	uint8_t *file;
+
+	offset = vendor_flash_u32(request);
+	size   = (uint32_t)(*(request+4) <<  0) |
+	         (uint32_t)(*(request+5) <<  8);
+
+	if (size > (DAP_PACKET_SIZE - 7U))
+	{
+		return ((6U << 16) | vendor_flash_response(response, ERROR_ALGO_FILE));
+	}
+
+	if (offset == 0U)
+	{
+		vendor_flash.file_size = 0U;
+	}
+
+	// Chunks must arrive in order
+	if (offset != vendor_flash.file_size || offset + size > VENDOR_FLASH_ALGO_MAX)
+	{
+		return (((6U + size) << 16) | vendor_flash_response(response, ERROR_ALGO_FILE));
+	}
+
+	if (offset + size > vendor_flash.file_cap)
+	{
+		cap = (vendor_flash.file_cap == 0U) ? 4096U : vendor_flash.file_cap * 2U;
+		while (cap < offset + size)
+		{
+			cap *= 2U;
+		}
+
+		file = realloc(vendor_flash.file, cap);
+		if (file == NULL)
+		{
+			return (((6U + size) << 16) | vendor_flash_response(response, ERROR_INTERNAL));
+		}
+		vendor_flash.file = file;
+		vendor_flash.file_cap = cap;
+	}
+
+	memcpy(vendor_flash.file + offset, request + 6, size);
+	vendor_flash.file_size = offset + size;
+
+	return (((6U + size) << 16) | vendor_flash_response(response, ERROR_SUCCESS));
+}
+
+uint32_t DAP_VendorFlashInit(const uint8_t *request, uint8_t *response)
+{
+	uint32_t ram_start;
+	uint32_t ram_size;
+	dap_err_t ret;
+	FILE *fp;
+
+	ram_start = vendor_flash_u32(request + 0);
+	ram_size  = vendor_flash_u32(request + 4);
+
+	// A new session drops whatever the previous one left behind
+	vendor_flash_release();
+	vendor_flash.error = ERROR_SUCCESS;
+	vendor_flash.done = 0U;
+
+	if (vendor_flash.file_size == 0U || DAP_Data.debug_port != DAP_PORT_SWD)
+	{
+		return ((8U << 16) | vendor_flash_response(response, ERROR_ALGO_MISSING));
+	}
+
+	fp = fmemopen(vendor_flash.file, vendor_flash.file_size, "rb");
+	if (fp == NULL)
+	{
+		return ((8U << 16) | vendor_flash_response(response, ERROR_INTERNAL));
+	}
+	ret = flash_algo_load_stream(fp, ram_start, ram_size, &vendor_flash.algo);
+	fclose(fp);
+
+	free(vendor_flash.file);
+	vendor_flash.file = NULL;
+	vendor_flash.file_size = 0U;
+	vendor_flash.file_cap = 0U;
+
+	if (ret == ERROR_SUCCESS)
+	{
+		vendor_flash.page = malloc(vendor_flash.algo.page_size);
+		if (vendor_flash.page == NULL)
+		{
+			ret = ERROR_INTERNAL;
+		}
+	}
+
+	if (ret == ERROR_SUCCESS)
+	{
+		swd_forget_state();
+		ret = target_flash_init(&vendor_flash.algo);
+	}
+
+	if (ret != ERROR_SUCCESS)
+	{
+		vendor_flash_release();
+		return ((8U << 16) | vendor_flash_response(response, ret));
+	}
+
+	target_flash_pipe_init(&vendor_flash.pipe, &vendor_flash.algo);
+	vendor_flash.ready = 1;
+
+	vendor_flash_response(response, ERROR_SUCCESS);
+	vendor_flash_put_u32(response + 2, vendor_flash.algo.flash_start);
+	vendor_flash_put_u32(response + 6, vendor_flash.algo.flash_size);
+	vendor_flash_put_u32(response + 10, vendor_flash.algo.page_size);
+
+	return ((8U << 16) | 14U);
+}
+
+uint32_t DAP_VendorFlashErase(const uint8_t *request, uint8_t *response)
+{
+	const program_target_t *target = &vendor_flash.algo.target;
+	uint32_t address;
+	uint32_t size;
+	dap_err_t ret;
+
+	address = vendor_flash_u32(request + 0);
+	size    = vendor_flash_u32(request + 4);
+
+	ret = vendor_flash_begin();
+	if (ret == ERROR_SUCCESS)
+	{
+		ret = vendor_flash_sync();
+	}
+	if (ret == ERROR_SUCCESS)
+	{
+		ret = vendor_flash_select(TARGET_FLASH_FUNC_ERASE);
+	}
+
+	if (ret == ERROR_SUCCESS)
+	{
+		vendor_flash.done = 0U;
+		vendor_flash.erasing = 1;
+		vendor_flash.erase_chip = (size == 0U);
+
+		if (vendor_flash.erase_chip)
+		{
+			if (!swd_flash_syscall_start(&target->sys_call_s, target->erase_chip, 0, 0, 0, 0))
+			{
+				vendor_flash.erasing = 0;
+				ret = ERROR_ERASE_ALL;
+			}
+		}
+		else
+		{
+			vendor_flash.erase_addr = address;
+			vendor_flash.erase_end = address + size;
+			ret = vendor_flash_erase_next();
+		}
+	}
+
+	if (ret != ERROR_SUCCESS)
+	{
+		vendor_flash_fail(ret);
+	}
+
+	return ((8U << 16) | vendor_flash_response(response, ret));
+}
+
+uint32_t DAP_VendorFlashProgram(const uint8_t *request, uint8_t *response)
+{
+	const flash_algo_t *algo = &vendor_flash.algo;
+	const uint8_t *data;
+	uint32_t address;
+	uint32_t count;
+	uint32_t size;
+	uint32_t sector_size;
+	uint32_t offset;
+	uint32_t n;
+	dap_err_t ret;
+
+	address = vendor_flash_u32(request);
+	count   = (uint32_t)(*(request+4) <<  0) |
+	          (uint32_t)(*(request+5) <<  8);
+	data    = request + 6;
+	size    = count;
+
+	if (size > (DAP_PACKET_SIZE - 7U))
+	{
+		return ((6U << 16) | vendor_flash_response(response, ERROR_INTERNAL));
+	}
+
+	ret = vendor_flash_begin();
+	if (ret == ERROR_SUCCESS)
+	{
+		ret = vendor_flash_erase_poll(1);
+	}
+	if (ret == ERROR_SUCCESS && vendor_flash.function != TARGET_FLASH_FUNC_PROGRAM)
+	{
+		ret = vendor_flash_program_poll(1);
+		if (ret == ERROR_SUCCESS)
+		{
+			ret = vendor_flash_select(TARGET_FLASH_FUNC_PROGRAM);
+		}
+		if (ret == ERROR_SUCCESS)
+		{
+			vendor_flash.done = 0U;
+		}
+	}
+
+	while (ret == ERROR_SUCCESS && size > 0U)
+	{
+		// Data only moves forward inside a page, anything else starts a new page
+		if (vendor_flash.page_open &&
+			(address < vendor_flash.page_addr + vendor_flash.page_fill ||
+			 address >= vendor_flash.page_addr + algo->page_size))
+		{
+			ret = vendor_flash_write_page();
+			if (ret != ERROR_SUCCESS)
+			{
+				break;
+			}
+		}
+
+		if (!vendor_flash.page_open)
+		{
+			flash_algo_sector(algo, address, &sector_size);
+			if (sector_size == 0U)
+			{
+				ret = ERROR_IMAGE_BOUNDS;
+				break;
+			}
+
+			vendor_flash.page_addr = address - (address - algo->flash_start) % algo->page_size;
+			vendor_flash.page_fill = 0U;
+			vendor_flash.page_open = 1;
+			memset(vendor_flash.page, algo->erased_value, algo->page_size);
+		}
+
+		offset = address - vendor_flash.page_addr;
+		n = algo->page_size - offset;
+		if (n > size)
+		{
+			n = size;
+		}
+
+		memcpy(vendor_flash.page + offset, data, n);
+		vendor_flash.page_fill = offset + n;
+		address += n;
+		data += n;
+		size -= n;
+
+		if (vendor_flash.page_fill == algo->page_size)
+		{
+			ret = vendor_flash_write_page();
+		}
+	}
+
+	if (ret != ERROR_SUCCESS)
+	{
+		vendor_flash_fail(ret);
+	}
+
+	return (((6U + count) << 16) | vendor_flash_response(response, ret));
+}
+
+uint32_t DAP_VendorFlashVerify(const uint8_t *request, uint8_t *response)
+{
+	uint32_t address;
+	uint32_t size;
+	uint32_t crc;
+	dap_err_t ret;
+
+	address = vendor_flash_u32(request + 0);
+	size    = vendor_flash_u32(request + 4);
+	crc     = vendor_flash_u32(request + 8);
+
+	ret = vendor_flash_begin();
+	if (ret == ERROR_SUCCESS)
+	{
+		ret = vendor_flash_sync();
+	}
+	if (ret == ERROR_SUCCESS)
+	{
+		ret = vendor_flash_select(TARGET_FLASH_FUNC_VERIFY);
+	}
+
+	if (ret != ERROR_SUCCESS)
+	{
+		vendor_flash_fail(ret);
+	}
+	else
+	{
+		// A mismatch is reported but does not end the session, the host may reprogram the range
+		ret = ((size & 3U) != 0U) ? ERROR_IMAGE_BOUNDS
+								  : target_flash_verify_crc32(&vendor_flash.algo, address, size, crc);
+	}
+
+	return ((12U << 16) | vendor_flash_response(response, ret));
+}
+
+uint32_t DAP_VendorFlashStatus(const uint8_t *request, uint8_t *response)
+{
+	dap_err_t ret;
+
+	(void)request;
+
+	ret = vendor_flash_begin();
+	if (ret == ERROR_SUCCESS)
+	{
+		ret = vendor_flash_erase_poll(0);
+	}
+	if (ret == ERROR_SUCCESS)
+	{
+		ret = vendor_flash_program_poll(0);
+	}
+
+	if (ret != ERROR_SUCCESS && vendor_flash.ready)
+	{
+		vendor_flash_fail(ret);
+	}
+
+	vendor_flash_response(response, ret);
+	*(response+2) = (vendor_flash.erasing || vendor_flash.pipe.busy) ? 1U : 0U;
+	vendor_flash_put_u32(response + 3, vendor_flash.done);
+
+	return ((0U << 16) | 7U);
+}
+
+uint32_t DAP_VendorFlashUninit(const uint8_t *request, uint8_t *response)
+{
+	dap_err_t ret;
+	dap_err_t ret2;
+
+	ret = vendor_flash_begin();
+	if (ret == ERROR_SUCCESS)
+	{
+		ret = vendor_flash_sync();
+	}
+
+	// Leave the target in a known state even after an error
+	swd_forget_state();
+
+	if (vendor_flash.ready && vendor_flash.function != 0)
+	{
+		ret2 = target_flash_func_uninit(&vendor_flash.algo, vendor_flash.function);
+		ret = (ret == ERROR_SUCCESS) ? ret2 : ret;
+	}
+
+	if (vendor_flash.ready && *request != 0U)
+	{
+		ret2 = target_flash_uninit();
+		ret = (ret == ERROR_SUCCESS) ? ret2 : ret;
+	}
+
+	vendor_flash_release();
+
+	return ((1U << 16) | vendor_flash_response(response, ret));
+}
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""Generate the .FLM fixtures used by test_flm.c.
+
+No ARM toolchain is needed: the files are minimal ELF32 images laid out the
+way the CMSIS flash algorithm template links them (PrgCode, PrgData, DevDscr,
+symbol table). The code bytes are a counting pattern so the test can check
+where each section lands in the blob.
+
+    python3 gen_flm.py      # rewrites the .FLM files next to this script
+"""
+
+import os
+import struct
+
+SECTOR_END = (0xFFFFFFFF, 0xFFFFFFFF)
+
+SHT_PROGBITS = 1
+SHT_SYMTAB = 2
+SHT_STRTAB = 3
+SHT_NOBITS = 8
+SHF_WRITE = 0x1
+SHF_ALLOC = 0x2
+SHF_EXECINSTR = 0x4
+
+STT_FUNC_GLOBAL = 0x12
+STT_OBJECT_GLOBAL = 0x11
+
+
+def flash_device(name, dev_adr, sz_dev, sz_page, val_empty, sectors):
+    """struct FlashDevice from FlashOS.H"""
+    dev = bytearray(160 + 8 * (len(sectors) + 1))
+    struct.pack_into('<H', dev, 0, 0x0101)
+    struct.pack_into('128s', dev, 2, name.encode())
+    struct.pack_into('<H', dev, 130, 1)
+    struct.pack_into('<IIIIB3xII', dev, 132, dev_adr, sz_dev, sz_page, 0, val_empty, 100, 3000)
+    for i, (size, offset) in enumerate(list(sectors) + [SECTOR_END]):
+        struct.pack_into('<II', dev, 160 + 8 * i, size, offset)
+    return bytes(dev)
+
+
+def build(code, data, bss, dev_addr, device, symbols):
+    """symbols: (name, value, section) with section 'code' or 'dev'"""
+    data_addr = len(code)
+    shstr = b'\0PrgCode\0PrgData\0DevDscr\0.symtab\0.strtab\0.shstrtab\0'
+    strtab = b'\0' + b''.join(name.encode() + b'\0' for name, _, _ in symbols)
+
+    def shname(name):
+        return shstr.index(name.encode() + b'\0')
+
+    body = bytearray(52)
+
+    def add(blob):
+        offset = len(body)
+        body.extend(blob)
+        while len(body) % 4:
+            body.append(0)
+        return offset
+
+    sections = [(0,) * 10]
+
+    def section(name, sh_type, flags, addr, offset, size, link=0, info=0, align=4, entsize=0):
+        sections.append((shname(name), sh_type, flags, addr, offset, size, link, info, align, entsize))
+        return len(sections) - 1
+
+    code_idx = section('PrgCode', SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 0, add(code), len(code))
+    section('PrgData', SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, data_addr, add(data), len(data))
+    if bss:
+        section('PrgData', SHT_NOBITS, SHF_ALLOC | SHF_WRITE, data_addr + len(data), len(body), bss)
+    dev_idx = section('DevDscr', SHT_PROGBITS, SHF_ALLOC, dev_addr, add(device), len(device))
+
+    syms = [struct.pack('<IIIBBH', 0, 0, 0, 0, 0, 0)]
+    name_offset = 1
+    for name, value, where in symbols:
+        kind = STT_OBJECT_GLOBAL if where == 'dev' else STT_FUNC_GLOBAL
+        shndx = dev_idx if where == 'dev' else code_idx
+        syms.append(struct.pack('<IIIBBH', name_offset, value, 0, kind, 0, shndx))
+        name_offset += len(name) + 1
+    symtab = b''.join(syms)
+
+    strtab_idx = len(sections) + 1
+    section('.symtab', SHT_SYMTAB, 0, 0, add(symtab), len(symtab), strtab_idx, 1, 4, 16)
+    section('.strtab', SHT_STRTAB, 0, 0, add(strtab), len(strtab), align=1)
+    shstrndx = section('.shstrtab', SHT_STRTAB, 0, 0, add(shstr), len(shstr), align=1)
+
+    shoff = len(body)
+    for sh in sections:
+        body += struct.pack('<10I', *sh)
+
+    ident = b'\x7fELF\x01\x01\x01' + b'\0' * 9
+    struct.pack_into('<16sHHIIIIIHHHHHH', body, 0, ident, 2, 40, 1, 0, 0, shoff, 0x05000000,
+                     52, 0, 0, 40, len(sections), shstrndx)
+    return bytes(body)
+
+
+def pattern(size, start):
+    return bytes((start + i) & 0xFF for i in range(size))
+
+
+FIXTURES = {
+    # STM32F10x 64 KB: 1 KB pages, mandatory entries only, no .bss
+    'STM32F10x_64.FLM': build(
+        code=pattern(0x180, 0x01), data=pattern(0x10, 0x80), bss=0, dev_addr=0x1000,
+        device=flash_device('STM32F10x 64kB Flash', 0x08000000, 0x10000, 0x400, 0xFF,
+                            [(0x400, 0x000000)]),
+        symbols=[('$t', 0, 'code'), ('Init', 0x001, 'code'), ('UnInit', 0x041, 'code'),
+                 ('EraseSector', 0x0C1, 'code'), ('ProgramPage', 0x101, 'code'),
+                 ('FlashDevice', 0x1000, 'dev')]),
+
+    # Mixed sector sizes, all six entries, .bss behind PrgData, erased value 0x00,
+    # a long symbol that shares a prefix with an entry name
+    'Mixed_256.FLM': build(
+        code=pattern(0x2A0, 0x40), data=pattern(0x24, 0xC0), bss=0x20, dev_addr=0x2000,
+        device=flash_device('Mixed 256kB Flash', 0x00100000, 0x40000, 0x100, 0x00,
+                            [(0x4000, 0x00000), (0x10000, 0x10000), (0x20000, 0x20000)]),
+        symbols=[('FlashDevice', 0x2000, 'dev'), ('Verify', 0x261, 'code'),
+                 ('ProgramPage', 0x1E1, 'code'), ('EraseSectorInternal', 0x301, 'code'),
+                 ('EraseSector', 0x161, 'code'), ('EraseChip', 0x121, 'code'),
+                 ('UnInit', 0x0A1, 'code'), ('Init', 0x005, 'code')]),
+}
+
+
+if __name__ == '__main__':
+    here = os.path.dirname(os.path.abspath(__file__))
+    for name, blob in FIXTURES.items():
+        with open(os.path.join(here, name), 'wb') as f:
+            f.write(blob)
@@ -0,0 +1,191 @@
+/**
+ * @file    test_flm.c
+ * @brief   Host tests for the .FLM loader
+ *
+ * The fixtures are generated by fixtures/gen_flm.py. PrgCode and PrgData
+ * hold counting patterns so the blob contents show where each section was
+ * placed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flm.h"
+
+#define RAM_START   0x20000000
+#define RAM_SIZE    0x5000
+
+static int failures;
+
+#define CHECK_EQ(actual, expected)                                                      \
+	do                                                                                  \
+	{                                                                                   \
+		unsigned long _a = (unsigned long)(actual);                                     \
+		unsigned long _e = (unsigned long)(expected);                                   \
+		if (_a != _e)                                                                   \
+		{                                                                               \
+			printf("%s:%d: %s = 0x%lx, expected 0x%lx\n", __FILE__, __LINE__, #actual, _a, _e); \
+			failures++;                                                                 \
+		}                                                                               \
+	} while (0)
+
+static dap_err_t load(const char *name, uint32_t ram_size, flash_algo_t *algo)
+{
+	char path[512];
+	dap_err_t ret;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/%s", FIXTURE_DIR, name);
+	fp = fopen(path, "rb");
+	if (fp == NULL)
+	{
+		printf("cannot open %s\n", path);
+		failures++;
+		return ERROR_ALGO_FILE;
+	}
+
+	memset(algo, 0, sizeof(*algo));
+	ret = flm_load(fp, RAM_START, ram_size, algo);
+	fclose(fp);
+
+	return ret;
+}
+
+// Every byte of [offset, offset + size) in the blob follows the generator's pattern
+static void check_pattern(const flash_algo_t *algo, uint32_t offset, uint32_t size, uint8_t start)
+{
+	const uint8_t *blob = (const uint8_t *)algo->target.algo_blob + FLASH_ALGO_HEADER_SIZE;
+	uint32_t i;
+
+	for (i = 0; i < size; i++)
+	{
+		if (blob[offset + i] != (uint8_t)(start + i))
+		{
+			printf("blob[0x%x] = 0x%02x, expected 0x%02x\n", (unsigned)(offset + i), blob[offset + i],
+				   (uint8_t)(start + i));
+			failures++;
+			return;
+		}
+	}
+}
+
+static void test_stm32f10x(void)
+{
+	const uint32_t code_base = RAM_START + FLASH_ALGO_HEADER_SIZE;
+	flash_algo_t algo;
+
+	if (load("STM32F10x_64.FLM", RAM_SIZE, &algo) != ERROR_SUCCESS)
+	{
+		printf("%s: load failed\n", __func__);
+		failures++;
+		return;
+	}
+
+	// PrgCode at 0, PrgData right behind it
+	CHECK_EQ(algo.target.algo_blob[0], 0xE7FEBE00);
+	check_pattern(&algo, 0x000, 0x180, 0x01);
+	check_pattern(&algo, 0x180, 0x10, 0x80);
+	CHECK_EQ(algo.target.algo_start, RAM_START);
+
+	CHECK_EQ(algo.flash_start, 0x08000000);
+	CHECK_EQ(algo.flash_size, 0x10000);
+	CHECK_EQ(algo.page_size, 0x400);
+	CHECK_EQ(algo.erased_value, 0xFF);
+	CHECK_EQ(algo.sector_count, 1);
+	CHECK_EQ(algo.sectors[0].start, 0x08000000);
+	CHECK_EQ(algo.sectors[0].size, 0x400);
+
+	CHECK_EQ(algo.target.init, code_base + 0x001);
+	CHECK_EQ(algo.target.uninit, code_base + 0x041);
+	CHECK_EQ(algo.target.erase_sector, code_base + 0x0C1);
+	CHECK_EQ(algo.target.program_page, code_base + 0x101);
+	CHECK_EQ(algo.target.erase_chip, 0);
+	CHECK_EQ(algo.target.verify, 0);
+	CHECK_EQ(algo.target.sys_call_s.static_base, code_base + 0x180);
+	CHECK_EQ(algo.target.sys_call_s.breakpoint, RAM_START + 1);
+	CHECK_EQ(algo.target.sys_call_s.stack_pointer, RAM_START + RAM_SIZE);
+
+	flash_algo_free(&algo);
+}
+
+static void test_mixed_sectors(void)
+{
+	const uint32_t code_base = RAM_START + FLASH_ALGO_HEADER_SIZE;
+	const uint8_t *blob;
+	flash_algo_t algo;
+	uint32_t size;
+	uint32_t i;
+
+	if (load("Mixed_256.FLM", RAM_SIZE, &algo) != ERROR_SUCCESS)
+	{
+		printf("%s: load failed\n", __func__);
+		failures++;
+		return;
+	}
+
+	check_pattern(&algo, 0x000, 0x2A0, 0x40);
+	check_pattern(&algo, 0x2A0, 0x24, 0xC0);
+
+	// .bss behind PrgData is part of the algorithm and zeroed
+	blob = (const uint8_t *)algo.target.algo_blob + FLASH_ALGO_HEADER_SIZE;
+	for (i = 0x2C4; i < 0x2E4; i++)
+	{
+		CHECK_EQ(blob[i], 0);
+	}
+	CHECK_EQ(algo.target.algo_size >= FLASH_ALGO_HEADER_SIZE + 0x2E4, 1);
+
+	CHECK_EQ(algo.flash_start, 0x00100000);
+	CHECK_EQ(algo.flash_size, 0x40000);
+	CHECK_EQ(algo.page_size, 0x100);
+	CHECK_EQ(algo.erased_value, 0x00);
+	CHECK_EQ(algo.sector_count, 3);
+	CHECK_EQ(algo.sectors[0].start, 0x00100000);
+	CHECK_EQ(algo.sectors[0].size, 0x4000);
+	CHECK_EQ(algo.sectors[1].start, 0x00110000);
+	CHECK_EQ(algo.sectors[1].size, 0x10000);
+	CHECK_EQ(algo.sectors[2].start, 0x00120000);
+	CHECK_EQ(algo.sectors[2].size, 0x20000);
+
+	CHECK_EQ(flash_algo_sector(&algo, 0x00103FFF, &size), 0x00100000);
+	CHECK_EQ(size, 0x4000);
+	CHECK_EQ(flash_algo_sector(&algo, 0x00104000, &size), 0x00104000);
+	CHECK_EQ(flash_algo_sector(&algo, 0x0013FFFF, &size), 0x00120000);
+	CHECK_EQ(size, 0x20000);
+
+	// EraseSectorInternal must not be taken for EraseSector
+	CHECK_EQ(algo.target.init, code_base + 0x005);
+	CHECK_EQ(algo.target.uninit, code_base + 0x0A1);
+	CHECK_EQ(algo.target.erase_chip, code_base + 0x121);
+	CHECK_EQ(algo.target.erase_sector, code_base + 0x161);
+	CHECK_EQ(algo.target.program_page, code_base + 0x1E1);
+	CHECK_EQ(algo.target.verify, code_base + 0x261);
+	CHECK_EQ(algo.target.sys_call_s.static_base, code_base + 0x2A0);
+
+	flash_algo_free(&algo);
+}
+
+static void test_ram_too_small(void)
+{
+	flash_algo_t algo;
+
+	// The 0x2E4 byte algorithm fits, the page buffer and stack do not
+	CHECK_EQ(load("Mixed_256.FLM", 0x600, &algo), ERROR_ALGO_RAM);
+	CHECK_EQ(load("Mixed_256.FLM", 0x200, &algo), ERROR_ALGO_RAM);
+}
+
+int main(void)
+{
+	test_stm32f10x();
+	test_mixed_sectors();
+	test_ram_too_small();
+
+	if (failures != 0)
+	{
+		printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	printf("all checks passed\n");
+	return 0;
+}
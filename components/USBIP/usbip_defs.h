@@ -25,6 +25,7 @@
 
 #define USBIP_SYSFS_PATH_SIZE 256
 #define USBIP_BUSID_SIZE 32
+#define USBIP_VERSION 0x0111
 
 enum usbip_stage1_command
 {
@@ -33,6 +34,15 @@ enum usbip_stage1_command
     USBIP_STAGE1_CMD_DEVICE_ATTACH = 0x03, // OP_REQ_IMPORT
 };
 
+// Offset 4 of the stage1 reply
+enum usbip_stage1_status
+{
+    USBIP_ST_OK = 0x00,
+    USBIP_ST_NA = 0x01,
+    USBIP_ST_DEV_BUSY = 0x02,
+    USBIP_ST_DEV_ERR = 0x03,
+};
+
 enum usbip_stager2_command
 {
     //Offset 0
@@ -1,4 +1,6 @@
 #include "components/elaphureLink/elaphureLink_protocol.h"
+#include "components/DAP/Include/DAP_config.h"
+#include "components/DAP/Include/DAP.h"
 
 
 #include "lwip/err.h"
@@ -9,29 +11,18 @@
 extern int kSock;
 extern int usbip_network_send(int s, const void *dataptr, size_t size, int flags);
 
-extern void malloc_dap_ringbuf();
-extern void free_dap_ringbuf();
+extern void handle_dap_el_request(const uint8_t *data, uint32_t length);
 
 extern uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response);
 
-uint8_t* el_process_buffer = NULL;
+// Responses of one batch are collected here and sent together
+#define EL_PROCESS_BUFFER_SIZE 1500
 
-void el_process_buffer_malloc() {
-    if (el_process_buffer != NULL)
-        return;
+// Batches are queued to the DAP thread in pieces of at most this size
+#define EL_REQUEST_CHUNK_SIZE 1024
 
-    free_dap_ringbuf();
-
-    el_process_buffer = malloc(1500);
-}
-
-
-void el_process_buffer_free() {
-    if (el_process_buffer != NULL) {
-        free(el_process_buffer);
-        el_process_buffer = NULL;
-    }
-}
+// Only used by the DAP thread
+static uint8_t el_process_buffer[EL_PROCESS_BUFFER_SIZE];
 
 
 int el_handshake_process(int fd, void *buffer, size_t len) {
@@ -61,8 +52,292 @@ int el_handshake_process(int fd, void *buffer, size_t len) {
 
 
 void el_dap_data_process(void* buffer, size_t len) {
-    int res = DAP_ExecuteCommand(buffer, (uint8_t *)el_process_buffer);
-    res &= 0xFFFF;
+    const uint8_t *request = (const uint8_t *)buffer;
+    size_t chunk = 0, n;
+
+    // The batch holds complete commands, split it only between them
+    while (chunk < len) {
+        n = el_dap_request_length(request + chunk, len - chunk);
+        if (n == 0 || n > len - chunk) {
+            n = len - chunk;
+        }
+
+        if (chunk > 0 && chunk + n > EL_REQUEST_CHUNK_SIZE) {
+            handle_dap_el_request(request, chunk);
+            request += chunk;
+            len -= chunk;
+            chunk = 0;
+            continue;
+        }
+        chunk += n;
+    }
+
+    if (chunk > 0) {
+        handle_dap_el_request(request, chunk);
+    }
+}
+
+
+void el_dap_execute(const void* buffer, size_t len) {
+    const uint8_t *request = (const uint8_t *)buffer;
+    size_t response_len = 0;
+    uint32_t res, request_len;
+    size_t n;
+
+    while (len > 0) {
+        // Commands after an open ended one are run only once complete
+        if (request != buffer) {
+            n = el_dap_request_length(request, len);
+            if (n == 0 || n > len) {
+                break;
+            }
+        }
+
+        // Send what has been collected when another response may not fit
+        if (EL_PROCESS_BUFFER_SIZE - response_len < DAP_PACKET_SIZE) {
+            usbip_network_send(kSock, el_process_buffer, response_len, 0);
+            response_len = 0;
+        }
+
+        res = DAP_ExecuteCommand(request, el_process_buffer + response_len);
+        response_len += res & 0xFFFF;
+
+        request_len = res >> 16;
+        if (request_len == 0 || request_len >= len) {
+            break;
+        }
+        request += request_len;
+        len -= request_len;
+    }
+
+    if (response_len > 0) {
+        usbip_network_send(kSock, el_process_buffer, response_len, 0);
+    }
+}
+
+
+void el_dap_reject(const void* buffer, size_t len) {
+    const uint8_t *request = (const uint8_t *)buffer;
+    size_t response_len = 0;
+    size_t n;
+
+    while (len > 0) {
+        n = el_dap_request_length(request, len);
+        if (n == 0 || n > len) {
+            n = len;
+        }
+
+        if (response_len == EL_PROCESS_BUFFER_SIZE) {
+            usbip_network_send(kSock, el_process_buffer, response_len, 0);
+            response_len = 0;
+        }
+
+        el_process_buffer[response_len++] = ID_DAP_Invalid;
+        request += n;
+        len -= n;
+    }
+
+    if (response_len > 0) {
+        usbip_network_send(kSock, el_process_buffer, response_len, 0);
+    }
+}
+
+
+// Bytes of sequence data behind an info byte, a count of 0 means 64 bits
+static size_t el_sequence_bytes(uint8_t info) {
+    size_t n = info & 0x3FU;
+
+    return ((n ? n : 64U) + 7U) / 8U;
+}
+
+
+// open_ended is set for commands whose length is unknown
+static size_t el_command_length(const uint8_t *buf, size_t len, uint8_t *open_ended) {
+    size_t need, count, n;
+
+    if (len < 1) {
+        return 0;
+    }
+
+    switch (buf[0]) {
+    case ID_DAP_Disconnect:
+    case ID_DAP_TransferAbort:
+    case ID_DAP_ResetTarget:
+    case ID_DAP_SWO_Status:
+    case ID_DAP_UART_Status:
+        return 1;
+
+    case ID_DAP_Info:
+    case ID_DAP_Connect:
+    case ID_DAP_SWD_Configure:
+    case ID_DAP_JTAG_IDCODE:
+    case ID_DAP_SWO_Transport:
+    case ID_DAP_SWO_Mode:
+    case ID_DAP_SWO_Control:
+    case ID_DAP_SWO_ExtendedStatus:
+    case ID_DAP_UART_Transport:
+    case ID_DAP_UART_Control:
+        return 2;
+
+    case ID_DAP_HostStatus:
+    case ID_DAP_Delay:
+    case ID_DAP_SWO_Data:
+        return 3;
+
+    case ID_DAP_SWJ_Clock:
+    case ID_DAP_SWO_Baudrate:
+        return 5;
+
+    case ID_DAP_TransferConfigure:
+    case ID_DAP_WriteABORT:
+    case ID_DAP_UART_Configure:
+        return 6;
+
+    case ID_DAP_SWJ_Pins:
+        return 7;
+
+    case ID_DAP_SWJ_Sequence:
+        if (len < 2) {
+            return 0;
+        }
+        n = buf[1] ? buf[1] : 256U;
+        return 2 + (n + 7U) / 8U;
+
+    case ID_DAP_SWD_Sequence:
+    case ID_DAP_JTAG_Sequence:
+        if (len < 2) {
+            return 0;
+        }
+        need = 2;
+        for (count = buf[1]; count; count--) {
+            if (len < need + 1) {
+                return 0;
+            }
+            n = buf[need++];
+            // SWD input sequences carry no data, JTAG always sends TDI
+            if (buf[0] == ID_DAP_JTAG_Sequence || (n & SWD_SEQUENCE_DIN) == 0) {
+                need += el_sequence_bytes(n);
+            }
+        }
+        return need;
+
+    case ID_DAP_JTAG_Configure:
+        if (len < 2) {
+            return 0;
+        }
+        return 2 + buf[1];
+
+    case ID_DAP_Transfer:
+        if (len < 3) {
+            return 0;
+        }
+        need = 3;
+        for (count = buf[2]; count; count--) {
+            if (len < need + 1) {
+                return 0;
+            }
+            n = buf[need++];
+            if ((n & DAP_TRANSFER_RnW) == 0 || (n & DAP_TRANSFER_MATCH_VALUE) != 0) {
+                need += 4;
+            }
+        }
+        return need;
+
+    case ID_DAP_TransferBlock:
+        if (len < 5) {
+            return 0;
+        }
+        count = buf[2] | (buf[3] << 8);
+        return 5 + ((buf[4] & DAP_TRANSFER_RnW) ? 0 : count * 4);
+
+    case ID_DAP_UART_Transfer:
+        if (len < 3) {
+            return 0;
+        }
+        return 3 + (buf[1] | (buf[2] << 8));
+
+    case ID_DAP_VendorReadMemory:
+        return 7;
+
+    case ID_DAP_VendorWriteMemory:
+    case ID_DAP_VendorFlashLoad:
+    case ID_DAP_VendorFlashProgram:
+        if (len < 7) {
+            return 0;
+        }
+        return 7 + (buf[5] | (buf[6] << 8));
+
+    case ID_DAP_VendorFlashInit:
+    case ID_DAP_VendorFlashErase:
+        return 9;
+
+    case ID_DAP_VendorFlashVerify:
+        return 13;
+
+    case ID_DAP_VendorFlashStatus:
+        return 1;
+
+    case ID_DAP_VendorPollMemory:
+        return 17;
+
+    case ID_DAP_VendorFlashUninit:
+        return 2;
+
+    case ID_DAP_QueueCommands:
+    case ID_DAP_ExecuteCommands:
+        if (len < 2) {
+            return 0;
+        }
+        need = 2;
+        for (count = buf[1]; count; count--) {
+            if (len <= need) {
+                return 0;
+            }
+            n = el_command_length(buf + need, len - need, open_ended);
+            if (n == 0 || *open_ended) {
+                return n ? len : 0;
+            }
+            need += n;
+        }
+        return need;
+
+    default:
+        // Vendor and unknown commands carry no length, take what has arrived
+        *open_ended = 1;
+        return len;
+    }
+}
+
+
+size_t el_dap_request_length(const void *buffer, size_t len) {
+    uint8_t open_ended = 0;
+
+    return el_command_length((const uint8_t *)buffer, len, &open_ended);
+}
+
+
+size_t el_dap_batch_length(const void *buffer, size_t len) {
+    const uint8_t *buf = (const uint8_t *)buffer;
+    uint8_t open_ended = 0;
+    size_t total = 0, n;
+
+    while (total < len) {
+        n = el_command_length(buf + total, len - total, &open_ended);
+
+        // An open ended command takes the rest, it only starts a batch
+        if (n == 0 || n > len - total || (open_ended && total > 0)) {
+            break;
+        }
+
+        total += n;
+        if (open_ended) {
+            break;
+        }
+    }
+
+    if (total == 0) {
+        return el_dap_request_length(buffer, len);
+    }
 
-    usbip_network_send(kSock, el_process_buffer, res, 0);
+    return total;
 }
@@ -39,15 +39,56 @@ int el_handshake_process(int fd, void* buffer, size_t len);
 
 
 /**
- * @brief Process dap data and send to socket
+ * @brief Queue dap data to the DAP thread
  *
- * @param buffer dap data buffer
+ * @param buffer dap data buffer, one or more complete commands
  * @param len dap data length
  */
 void el_dap_data_process(void* buffer, size_t len);
 
 
-void el_process_buffer_malloc();
-void el_process_buffer_free();
+/**
+ * @brief Execute queued dap data and send the responses to socket
+ *
+ * Called from the DAP thread. The buffer may hold several concatenated
+ * commands, their responses are sent together.
+ *
+ * @param buffer dap data buffer
+ * @param len dap data length
+ */
+void el_dap_execute(const void* buffer, size_t len);
+
+
+/**
+ * @brief Answer every command in buffer with ID_DAP_Invalid without running it
+ *
+ * @param buffer dap data buffer
+ * @param len dap data length
+ */
+void el_dap_reject(const void* buffer, size_t len);
+
+
+/**
+ * @brief Length of the DAP command at the start of buffer
+ *
+ * @param buffer received dap data
+ * @param len bytes available in buffer
+ * @return length of the whole command, larger than len while the command
+ *         is incomplete, 0 if more data is needed to tell the length
+ */
+size_t el_dap_request_length(const void *buffer, size_t len);
+
+
+/**
+ * @brief Length of the complete commands at the start of buffer
+ *
+ * Partial commands behind them are left for the next segment.
+ *
+ * @param buffer received dap data
+ * @param len bytes available in buffer
+ * @return as el_dap_request_length() while not even the first command is complete
+ */
+size_t el_dap_batch_length(const void *buffer, size_t len);
+
 
 #endif
\ No newline at end of file
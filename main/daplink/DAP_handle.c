@@ -12,7 +12,9 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 #include "usbip_server.h"
 #include "DAP_handle.h"
@@ -21,6 +23,7 @@
 
 #include "components/USBIP/usb_descriptor.h"
 #include "components/DAP/Include/DAP.h"
+#include "components/elaphureLink/elaphureLink_protocol.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -38,29 +41,33 @@
     #define DAP_BUFFER_NUM 20
 #endif
 
-#if (USE_WINUSB == 1)
-typedef struct
-{
-    uint32_t length;
-    uint8_t buf[DAP_PACKET_SIZE];
-} DapPacket_t;
-#else
+// 环形缓冲区按实际长度存放条目 (NOSPLIT), 小命令只占用自身大小
+#define DAP_ALIGN4(x) (((x) + 3) & ~3)
+#define DAP_RINGBUF_ITEM_HEADER 8 // NOSPLIT 条目头
+#define DAP_DATAIN_SIZE  DAP_ALIGN4(DAP_BUFFER_NUM * (DAP_PACKET_SIZE + DAP_RINGBUF_ITEM_HEADER))
+// 响应条目: 回复头 + 响应, 响应直接生成在条目中, 按最大长度分配
+#define DAP_RESPONSE_SIZE (sizeof(usbip_stage2_header) + DAP_PACKET_SIZE)
+#define DAP_DATAOUT_SIZE DAP_ALIGN4(DAP_BUFFER_NUM * (DAP_RESPONSE_SIZE + DAP_RINGBUF_ITEM_HEADER))
+// 命令在缓冲区内原地处理, 末尾留出余量, 防止越过条目读取时越过存储区
+#define DAP_RINGBUF_TAIL_ROOM DAP_PACKET_SIZE
+// 小命令可以远多于 DAP_BUFFER_NUM 个同时在途
+#define DAP_URB_NUM (DAP_BUFFER_NUM * 2)
+
 typedef struct
 {
-    uint8_t buf[DAP_PACKET_SIZE];
-} DapPacket_t;
-#endif
-
-#define DAP_HANDLE_SIZE (sizeof(DapPacket_t))
+    RingbufHandle_t handle;
+    StaticRingbuffer_t ring;
+    uint8_t *storage;
+} dap_ringbuf_t;
 
 
 extern int kSock;
+extern uint8_t kState;
 extern TaskHandle_t kDAPTaskHandle;
 
 int kRestartDAPHandle = NO_SIGNAL;
 
 
-static DapPacket_t DAPDataProcessed;
 static int dap_respond = 0;
 
 // SWO Trace
@@ -68,35 +75,122 @@ static uint8_t *swo_data_to_send = NULL;
 static uint32_t swo_data_num;
 
 // DAP handle
-static RingbufHandle_t dap_dataIN_handle = NULL;
-static RingbufHandle_t dap_dataOUT_handle = NULL;
+static uint8_t DAPDataDiscarded[DAP_PACKET_SIZE]; // 输出缓冲区满时响应生成在这里并丢弃
+static dap_ringbuf_t dap_dataIN;  // 请求条目: 命令
+static dap_ringbuf_t dap_dataOUT; // 响应条目: 回复头 + 响应
 static SemaphoreHandle_t data_response_mux = NULL;
 
+// SWD引脚和swd_host/DAP_Data全局状态的所有权
+static SemaphoreHandle_t swd_owner_mux = NULL;
+static StaticSemaphore_t swd_owner_mux_buffer;
 
-void malloc_dap_ringbuf() {
-    if (data_response_mux && xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE)
+// 在途的 IN URB: 主机已提交但响应尚未生成, 由DAP线程生成响应后直接回复
+typedef struct
+{
+    usbip_stage2_header header; // 原始请求头(网络字节序), 回复时原地改写
+    uint32_t seqnum;
+    uint32_t order;             // 到达顺序, 响应按顺序分配给最早的URB
+    uint8_t used;
+} dap_urb_t;
+
+// 以下状态均受 data_response_mux 保护
+static dap_urb_t dap_urb_table[DAP_URB_NUM];
+static uint32_t dap_urb_order;
+static int dap_urb_pending; // 表中等待响应的 IN URB 数
+static int dap_inflight;    // 已入队但尚未处理完的请求数
+
+
+static void dap_urb_reset()
+{
+    memset(dap_urb_table, 0, sizeof(dap_urb_table));
+    dap_urb_pending = 0;
+    dap_inflight = 0;
+    dap_respond = 0;
+}
+
+static dap_urb_t *dap_urb_alloc()
+{
+    for (int i = 0; i < DAP_URB_NUM; i++)
+    {
+        if (!dap_urb_table[i].used)
+        {
+            return &dap_urb_table[i];
+        }
+    }
+    return NULL;
+}
+
+static dap_urb_t *dap_urb_oldest()
+{
+    dap_urb_t *oldest = NULL;
+
+    for (int i = 0; i < DAP_URB_NUM; i++)
     {
-        if (dap_dataIN_handle == NULL) {
-            dap_dataIN_handle = xRingbufferCreate(DAP_HANDLE_SIZE * DAP_BUFFER_NUM, RINGBUF_TYPE_BYTEBUF);
+        if (dap_urb_table[i].used &&
+            (oldest == NULL || (int32_t)(dap_urb_table[i].order - oldest->order) < 0))
+        {
+            oldest = &dap_urb_table[i];
         }
-        if (dap_dataOUT_handle == NULL) {
-            dap_dataOUT_handle = xRingbufferCreate(DAP_HANDLE_SIZE * DAP_BUFFER_NUM, RINGBUF_TYPE_BYTEBUF);
+    }
+    return oldest;
+}
+
+static dap_urb_t *dap_urb_find(uint32_t seqnum)
+{
+    for (int i = 0; i < DAP_URB_NUM; i++)
+    {
+        if (dap_urb_table[i].used && dap_urb_table[i].seqnum == seqnum)
+        {
+            return &dap_urb_table[i];
         }
+    }
+    return NULL;
+}
+
+
+static void dap_ringbuf_create(dap_ringbuf_t *rb, size_t size, size_t tail)
+{
+    if (rb->handle != NULL) {
+        return;
+    }
+
+    rb->storage = malloc(size + tail);
+    if (rb->storage == NULL) {
+        return;
+    }
+
+    rb->handle = xRingbufferCreateStatic(size, RINGBUF_TYPE_NOSPLIT, rb->storage, &rb->ring);
+    if (rb->handle == NULL) {
+        free(rb->storage);
+        rb->storage = NULL;
+    }
+}
+
+static void dap_ringbuf_delete(dap_ringbuf_t *rb)
+{
+    if (rb->handle) {
+        vRingbufferDelete(rb->handle);
+    }
+    free(rb->storage);
+
+    rb->handle = NULL;
+    rb->storage = NULL;
+}
 
+void malloc_dap_ringbuf() {
+    if (data_response_mux && xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE)
+    {
+        dap_ringbuf_create(&dap_dataIN, DAP_DATAIN_SIZE, DAP_RINGBUF_TAIL_ROOM);
+        dap_ringbuf_create(&dap_dataOUT, DAP_DATAOUT_SIZE, 0);
         xSemaphoreGive(data_response_mux);
     }
 }
 
 void free_dap_ringbuf() {
     if (data_response_mux && xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE) {
-        if (dap_dataIN_handle) {
-            vRingbufferDelete(dap_dataIN_handle);
-        }
-        if (dap_dataOUT_handle) {
-            vRingbufferDelete(dap_dataOUT_handle);
-        }
-
-        dap_dataIN_handle = dap_dataOUT_handle = NULL;
+        dap_urb_reset();
+        dap_ringbuf_delete(&dap_dataIN);
+        dap_ringbuf_delete(&dap_dataOUT);
         xSemaphoreGive(data_response_mux);
     }
 
@@ -108,26 +202,84 @@ void handle_dap_data_request(usbip_stage2_header *header, uint32_t length)
     uint8_t *data_in = (uint8_t *)header;
     data_in = &(data_in[sizeof(usbip_stage2_header)]);
     // Point to the beginning of the URB packet
+    uint32_t data_length = length - sizeof(usbip_stage2_header);
+    void *item = NULL;
+
+    if (header->u.cmd_submit.data_length >= 0 && (uint32_t)header->u.cmd_submit.data_length < data_length)
+    {
+        data_length = header->u.cmd_submit.data_length;
+    }
+    if (data_length > DAP_PACKET_SIZE)
+    {
+        data_length = DAP_PACKET_SIZE;
+    }
 
-#if (USE_WINUSB == 1)
     send_stage2_submit(header, 0, 0);
 
-    // always send constant size buf -> cuz we don't care about the IN packet size
-    // and to unify the style, we set aside the length of the section
-    xRingbufferSend(dap_dataIN_handle, data_in - sizeof(uint32_t), DAP_HANDLE_SIZE, portMAX_DELAY);
-    xTaskNotifyGive(kDAPTaskHandle);
+    if (data_length == 0)
+    {
+        return;
+    }
 
-#else
-    send_stage2_submit(header, 0, 0);
+    // 传输中止命令不入队, 立即打断正在执行的传输, 与CMSIS-DAP USB固件的处理相同
+    if (data_in[0] == ID_DAP_TransferAbort)
+    {
+        DAP_TransferAbort = 1U;
+        return;
+    }
+
+    // 条目按命令实际长度分配
+    // OUT URB 已经确认, 主机不会重发, 队列满时一直等待DAP线程腾出空间;
+    // 网络任务停止接收, 由TCP窗口/KCP窗口把压力传回主机
+    if (dap_dataIN.handle == NULL ||
+        xRingbufferSendAcquire(dap_dataIN.handle, &item, data_length, portMAX_DELAY) != pdTRUE)
+    {
+        os_printf("DAP request dropped, data in not ready!\r\n");
+        return;
+    }
+    memcpy(item, data_in, data_length);
+
+    if (xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE)
+    {
+        ++dap_inflight;
+        xSemaphoreGive(data_response_mux);
+    }
 
-    xRingbufferSend(dap_dataIN_handle, data_in, DAP_HANDLE_SIZE, portMAX_DELAY);
+    xRingbufferSendComplete(dap_dataIN.handle, item);
     xTaskNotifyGive(kDAPTaskHandle);
+}
 
-#endif
+/*
+ * elaphureLink请求入队, 与USBIP请求共用DAP线程执行
+ * 一个条目可包含多条命令, 由DAP线程执行后直接回复
+ */
+void handle_dap_el_request(const uint8_t *data, uint32_t length)
+{
+    void *item = NULL;
 
-    // dap_respond = DAP_ProcessCommand((uint8_t *)data_in, (uint8_t *)data_out);
-    // //handle_dap_data_response(header);
-    // send_stage2_submit(header, 0, 0);
+    // 传输中止命令同USBIP一样不入队, 立即打断正在执行的传输, 也不回复
+    if (data[0] == ID_DAP_TransferAbort)
+    {
+        DAP_TransferAbort = 1U;
+        data++;
+        length--;
+        if (length == 0)
+        {
+            return;
+        }
+    }
+
+    // elaphureLink没有重传, 队列满时一直等待DAP线程腾出空间
+    if (dap_dataIN.handle == NULL ||
+        xRingbufferSendAcquire(dap_dataIN.handle, &item, length, portMAX_DELAY) != pdTRUE)
+    {
+        os_printf("DAP request dropped, data in not ready!\r\n");
+        return;
+    }
+    memcpy(item, data, length);
+
+    xRingbufferSendComplete(dap_dataIN.handle, item);
+    xTaskNotifyGive(kDAPTaskHandle);
 }
 
 void handle_dap_data_response(usbip_stage2_header *header)
@@ -175,22 +327,110 @@ void SWO_QueueTransfer(uint8_t *buf, uint32_t num)
     swo_data_num = num;
 }
 
+/*
+ * 取出最早的响应, 以 req_header 为回复头与响应一起发出
+ * 排队期间响应长度暂存在条目的回复头中; 调用者持有 data_response_mux
+ */
+static int dap_send_response(const usbip_stage2_header *req_header)
+{
+    usbip_stage2_header *item;
+    size_t packetSize;
+    int32_t resLength;
+
+    item = (usbip_stage2_header *)xRingbufferReceive(dap_dataOUT.handle, &packetSize, 0);
+    if (item == NULL)
+    {
+        return 0;
+    }
+
+    resLength = item->u.ret_submit.data_length;
+    memcpy(item, req_header, sizeof(usbip_stage2_header));
+    send_stage2_submit_data_fast(item, resLength);
+    vRingbufferReturnItem(dap_dataOUT.handle, (void *)item);
+    --dap_respond;
+
+    return 1;
+}
+
+/*
+ * 请求处理完成, 响应已生成在 resp 条目中
+ * 条目提交到输出缓冲区; 有等待中的 IN URB 时直接回复最早的一个, 否则等待主机来取
+ */
+static void dap_complete_request(uint8_t *resp, int resLength)
+{
+    dap_urb_t *urb;
+
+    if (xSemaphoreTake(data_response_mux, portMAX_DELAY) != pdTRUE)
+    {
+        return;
+    }
+
+    if (dap_inflight > 0)
+    {
+        --dap_inflight;
+    }
+
+    if (resp != NULL)
+    {
+        ((usbip_stage2_header *)resp)->u.ret_submit.data_length = resLength;
+        xRingbufferSendComplete(dap_dataOUT.handle, resp);
+        ++dap_respond;
+
+        urb = dap_urb_oldest();
+        if (urb != NULL && dap_send_response(&urb->header))
+        {
+            urb->used = 0;
+            --dap_urb_pending;
+        }
+    }
+    else
+    {
+        os_printf("DAP response dropped, data out full!\r\n");
+    }
+
+    xSemaphoreGive(data_response_mux);
+}
+
 /*
  * DAP线程函数
  * 处理DAP命令的主要线程，负责接收、处理和发送DAP数据包
  */
+/**
+ * @brief 创建SWD所有权互斥锁, 须在DAP线程和脱机烧录任务启动前调用
+ */
+void dap_swd_owner_init(void)
+{
+    swd_owner_mux = xSemaphoreCreateMutexStatic(&swd_owner_mux_buffer);
+}
+
+/**
+ * @brief 获取SWD所有权
+ * @return 1: 成功; 0: 超时, 另一方正在使用SWD
+ */
+int dap_swd_take(uint32_t wait_ms)
+{
+    return xSemaphoreTake(swd_owner_mux, pdMS_TO_TICKS(wait_ms)) == pdTRUE;
+}
+
+void dap_swd_give(void)
+{
+    xSemaphoreGive(swd_owner_mux);
+}
+
 void DAP_Thread(void *argument)
 {
     // 创建用于DAP数据传输的环形缓冲区和互斥锁
-    dap_dataIN_handle = xRingbufferCreate(DAP_HANDLE_SIZE * DAP_BUFFER_NUM, RINGBUF_TYPE_BYTEBUF);
-    dap_dataOUT_handle = xRingbufferCreate(DAP_HANDLE_SIZE * DAP_BUFFER_NUM, RINGBUF_TYPE_BYTEBUF);
+    dap_ringbuf_create(&dap_dataIN, DAP_DATAIN_SIZE, DAP_RINGBUF_TAIL_ROOM);
+    dap_ringbuf_create(&dap_dataOUT, DAP_DATAOUT_SIZE, 0);
     data_response_mux = xSemaphoreCreateMutex();
     size_t packetSize;
     int resLength;
-    DapPacket_t *item;
+    uint8_t *item;
+    uint8_t *resp;
+    uint8_t *response;
 
     // 检查资源创建是否成功
-    if (dap_dataIN_handle == NULL || dap_dataIN_handle == NULL ||
+    if (dap_dataIN.handle == NULL || dap_dataOUT.handle == NULL ||
         data_response_mux == NULL)
     {
         os_printf("Can not create DAP ringbuf/mux!\r\n");
@@ -207,7 +447,7 @@ void DAP_Thread(void *argument)
 
                 if (kRestartDAPHandle == RESET_HANDLE) {
                     malloc_dap_ringbuf();
-                    if (dap_dataIN_handle == NULL || dap_dataIN_handle == NULL)
+                    if (dap_dataIN.handle == NULL || dap_dataOUT.handle == NULL)
                     {
                         os_printf("Can not create DAP ringbuf/mux!\r\n");
                         vTaskDelete(NULL);
@@ -220,143 +460,145 @@ void DAP_Thread(void *argument)
             ulTaskNotifyTake(pdFALSE, portMAX_DELAY); // 等待事件通知
 
             // 检查缓冲区是否可用
-            if (dap_dataIN_handle == NULL || dap_dataOUT_handle == NULL) {
-                continue; // 可能正在使用elaphureLink，等待...
+            if (dap_dataIN.handle == NULL || dap_dataOUT.handle == NULL) {
+                continue;
             }
 
-            // 从输入缓冲区接收数据包
+            // 从输入缓冲区取出一条命令, 条目长度即命令长度
             packetSize = 0;
-            item = (DapPacket_t *)xRingbufferReceiveUpTo(dap_dataIN_handle, &packetSize,
-                                                         pdMS_TO_TICKS(1), DAP_HANDLE_SIZE);
-            if (packetSize == 0)
+            item = (uint8_t *)xRingbufferReceive(dap_dataIN.handle, &packetSize, pdMS_TO_TICKS(1));
+            if (item == NULL)
             {
                 break;
             }
-            // 检查数据包大小是否正确
-            else if (packetSize < DAP_HANDLE_SIZE)
+
+            // elaphureLink: 执行整批命令并直接回复
+            // 脱机烧录占用SWD期间拒绝调试命令, 逐条回复 ID_DAP_Invalid
+            if (kState == EL_DATA_PHASE)
             {
-                os_printf("Wrong data in packet size:%d , data in remain: %d\r\n", packetSize, (int)xRingbufferGetMaxItemSize(dap_dataIN_handle));
-                vRingbufferReturnItem(dap_dataIN_handle, (void *)item);
-                break;
+                if (dap_swd_take(0))
+                {
+                    el_dap_execute(item, packetSize);
+                    dap_swd_give();
+                }
+                else
+                {
+                    el_dap_reject(item, packetSize);
+                }
+                vRingbufferReturnItem(dap_dataIN.handle, (void *)item);
+                continue;
             }
 
-            // 处理队列命令
-            if (item->buf[0] == ID_DAP_QueueCommands)
+            // 响应直接生成在输出缓冲区的条目中, 条目前部为回复头预留;
+            // 输出缓冲区满时照常执行命令, 响应丢弃
+            resp = NULL;
+            xRingbufferSendAcquire(dap_dataOUT.handle, (void **)&resp, DAP_RESPONSE_SIZE, 0);
+            response = (resp != NULL) ? resp + sizeof(usbip_stage2_header) : DAPDataDiscarded;
+
+            if (dap_swd_take(0))
             {
-                item->buf[0] = ID_DAP_ExecuteCommands;
-            }
+                // 处理队列命令
+                if (item[0] == ID_DAP_QueueCommands)
+                {
+                    item[0] = ID_DAP_ExecuteCommands;
+                }
 
-            // 处理DAP命令并获取响应
-            resLength = DAP_ProcessCommand((uint8_t *)item->buf, (uint8_t *)DAPDataProcessed.buf);
-            resLength &= 0xFFFF; // 响应长度在低16位
+                // 处理DAP命令并获取响应, 命令在缓冲区内原地处理
+                resLength = DAP_ProcessCommand(item, response);
+                resLength &= 0xFFFF; // 响应长度在低16位
+                dap_swd_give();
+            }
+            else
+            {
+                response[0] = ID_DAP_Invalid;
+                resLength = 1;
+            }
 
-            vRingbufferReturnItem(dap_dataIN_handle, (void *)item); // 处理完成，释放输入缓冲
+            vRingbufferReturnItem(dap_dataIN.handle, (void *)item); // 处理完成，释放输入缓冲
 
             // 准备回复数据
 #if (USE_WINUSB == 1)
-            DAPDataProcessed.length = resLength;
+            dap_complete_request(resp, resLength);
+#else
+            dap_complete_request(resp, DAP_PACKET_SIZE);
 #endif
-            xRingbufferSend(dap_dataOUT_handle, (void *)&DAPDataProcessed, DAP_HANDLE_SIZE, portMAX_DELAY);
-
-            // 更新响应计数器
-            if (xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE)
-            {
-                ++dap_respond;
-                xSemaphoreGive(data_response_mux);
-            }
         }
     }
 }
 
 /*
  * 快速回复函数
- * 用于处理DAP数据的快速响应，提高传输效率
+ * 处理端点1的 IN URB: 已有响应则立即回复; 响应尚在生成则登记到在途表,
+ * 由DAP线程完成后回复; 没有待处理的请求则回复空包
  */
 int fast_reply(uint8_t *buf, uint32_t length)
 {
     usbip_stage2_header *buf_header = (usbip_stage2_header *)buf;
+    dap_urb_t *urb;
+
     // 检查请求是否满足快速回复条件
-    if (length == 48 &&
-        buf_header->base.command == PP_HTONL(USBIP_STAGE2_REQ_SUBMIT) &&
-        buf_header->base.direction == PP_HTONL(USBIP_DIR_IN) &&
-        buf_header->base.ep == PP_HTONL(1))
+    if (length != 48 ||
+        buf_header->base.command != PP_HTONL(USBIP_STAGE2_REQ_SUBMIT) ||
+        buf_header->base.direction != PP_HTONL(USBIP_DIR_IN) ||
+        buf_header->base.ep != PP_HTONL(1))
     {
-        if (dap_respond > 0)
-        {
-            // 从输出缓冲区获取响应数据
-            DapPacket_t *item;
-            size_t packetSize = 0;
-            item = (DapPacket_t *)xRingbufferReceiveUpTo(dap_dataOUT_handle, &packetSize,
-                                                         pdMS_TO_TICKS(10), DAP_HANDLE_SIZE);
-            if (packetSize == DAP_HANDLE_SIZE)
-            {
-                // 发送响应数据
-#if (USE_WINUSB == 1)
-                send_stage2_submit_data_fast((usbip_stage2_header *)buf, item->buf, item->length);
-#else
-                send_stage2_submit_data_fast((usbip_stage2_header *)buf, item->buf, DAP_HANDLE_SIZE);
-#endif
+        return 0;
+    }
 
-                // 更新响应计数器
-                if (xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE)
-                {
-                    --dap_respond;
-                    xSemaphoreGive(data_response_mux);
-                }
+    if (xSemaphoreTake(data_response_mux, portMAX_DELAY) != pdTRUE)
+    {
+        return 0;
+    }
 
-                vRingbufferReturnItem(dap_dataOUT_handle, (void *)item);
-                return 1;
-            }
-            else if (packetSize > 0)
-            {
-                os_printf("Wrong data out packet size:%d!\r\n", packetSize);
-            }
-        }
-        else
-        {
-            // 发送空响应
-            buf_header->base.command = PP_HTONL(USBIP_STAGE2_RSP_SUBMIT);
-            buf_header->base.direction = PP_HTONL(USBIP_DIR_OUT);
-            buf_header->u.ret_submit.status = 0;
-            buf_header->u.ret_submit.data_length = 0;
-            buf_header->u.ret_submit.error_count = 0;
-            usbip_network_send(kSock, buf, 48, 0);
-            return 1;
-        }
+    if (dap_respond > 0 && dap_send_response(buf_header))
+    {
+        // 已有响应, 随本URB发出
+    }
+    else if (dap_urb_pending < dap_inflight && (urb = dap_urb_alloc()) != NULL)
+    {
+        // 响应尚未生成, 登记该URB
+        memcpy(&urb->header, buf_header, sizeof(usbip_stage2_header));
+        urb->seqnum = ntohl(buf_header->base.seqnum);
+        urb->order = dap_urb_order++;
+        urb->used = 1;
+        ++dap_urb_pending;
     }
-    return 0;
+    else
+    {
+        // 发送空响应
+        buf_header->base.command = PP_HTONL(USBIP_STAGE2_RSP_SUBMIT);
+        buf_header->base.direction = PP_HTONL(USBIP_DIR_OUT);
+        buf_header->u.ret_submit.status = 0;
+        buf_header->u.ret_submit.data_length = 0;
+        buf_header->u.ret_submit.error_count = 0;
+        usbip_network_send(kSock, buf, 48, 0);
+    }
+
+    xSemaphoreGive(data_response_mux);
+    return 1;
 }
 
-void handle_dap_unlink()
+/*
+ * 取消URB
+ * 只有仍在在途表中的 IN URB 能被取消, 返回 -ECONNRESET;
+ * 其余URB已经回复过, 返回0。取消不会丢弃响应, 响应留给下一个 IN URB
+ */
+int32_t handle_dap_unlink(uint32_t seqnum)
 {
-    // `USBIP_CMD_UNLINK` means calling `usb_unlink_urb()` or `usb_kill_urb()`.
-    // Note that execution of an URB is inherently an asynchronous operation, and there may be
-    // synchronization problems in the following solutions.
-
-    // One of the reasons this happens is that the host wants to abort the URB transfer operation
-    // as soon as possible. USBIP network fluctuations will also cause this error, but I don't know
-    // whether this is the main reason.
-
-    // Unlink may be applied to zero length URB of "DIR_IN", or a URB containing data.
-    // In the case of unlink, for the new "DIR_IN" request, it may always return an older response,
-    // which will lead to panic. This code is a compromise for eliminating the lagging response
-    // caused by UNLINK. It will clean up the buffers that may have data for return to the host.
-    // In general, we assume that there is at most one piece of data that has not yet been returned.
-    if (dap_respond > 0)
+    dap_urb_t *urb;
+    int32_t status = 0;
+
+    if (xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE)
     {
-        DapPacket_t *item;
-        size_t packetSize = 0;
-        item = (DapPacket_t *)xRingbufferReceiveUpTo(dap_dataOUT_handle, &packetSize,
-                                                     pdMS_TO_TICKS(10), DAP_HANDLE_SIZE);
-        if (packetSize == DAP_HANDLE_SIZE)
+        urb = dap_urb_find(seqnum);
+        if (urb != NULL)
         {
-            if (xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE)
-            {
-                --dap_respond;
-                xSemaphoreGive(data_response_mux);
-            }
-
-            vRingbufferReturnItem(dap_dataOUT_handle, (void *)item);
+            urb->used = 0;
+            --dap_urb_pending;
+            status = -ECONNRESET;
         }
+        xSemaphoreGive(data_response_mux);
     }
-}
\ No newline at end of file
+
+    return status;
+}
@@ -11,12 +11,18 @@ enum reset_handle_t
 };
 
 void handle_dap_data_request(usbip_stage2_header *header, uint32_t length);
+void handle_dap_el_request(const uint8_t *data, uint32_t length);
 void handle_dap_data_response(usbip_stage2_header *header);
 void handle_swo_trace_response(usbip_stage2_header *header);
-void handle_dap_unlink();
+int32_t handle_dap_unlink(uint32_t seqnum);
 
 void DAP_Thread(void *argument);
 
+// SWD所有权: 脱机烧录整个任务期间持有, DAP线程处理每条命令时持有
+void dap_swd_owner_init(void);
+int dap_swd_take(uint32_t wait_ms);
+void dap_swd_give(void);
+
 int fast_reply(uint8_t *buf, uint32_t length);
 
 #endif
\ No newline at end of file
@@ -30,6 +30,7 @@
 /// 此配置用于优化与调试器的通信性能,取决于USB外设
 /// 典型值:全速USB HID或WinUSB为64字节
 /// 高速USB HID为1024字节,高速USB WinUSB为512字节
+/// DAP组件的DAP_PACKET_SIZE(DAP_config.h)须与此一致
 #if (USE_WINUSB == 1)
     #define DAP_PACKET_SIZE 512U // WinUSB模式下为512字节
 #else
@@ -0,0 +1,461 @@
+/**
+ * @file kcp.c
+ * @brief 可靠UDP传输, 报文与KCP兼容
+ *
+ * 与标准KCP的nodelay模式相同:
+ *   - 不做拥塞控制, 发送窗口只受对端接收窗口限制
+ *   - 超时后RTO按1.5倍增长而不是翻倍
+ *   - 一个段被后续段的ACK跨越 KCP_FASTRESEND 次即立即重传
+ * 每个收到的数据段都单独ACK, 同时携带累计确认 una。
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "kcp.h"
+
+#define KCP_CMD_PUSH 81     // 数据
+#define KCP_CMD_ACK  82     // 确认
+#define KCP_CMD_WASK 83     // 询问窗口
+#define KCP_CMD_WINS 84     // 告知窗口
+
+#define KCP_ASK_SEND 1      // 需要发送 WASK
+#define KCP_ASK_TELL 2      // 需要发送 WINS
+
+static int32_t kcp_diff(uint32_t later, uint32_t earlier)
+{
+    return (int32_t)(later - earlier);
+}
+
+static uint8_t *kcp_encode32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+static uint32_t kcp_decode32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint8_t *kcp_encode_header(kcp_t *kcp, uint8_t *p, uint8_t cmd, uint32_t ts, uint32_t sn, uint32_t len)
+{
+    uint32_t wnd = 0;
+
+    for (int i = 0; i < KCP_WND; i++)
+    {
+        wnd += !kcp->rcv[i].used;
+    }
+
+    p = kcp_encode32(p, kcp->conv);
+    *p++ = cmd;
+    *p++ = 0;                   // frg, 流模式不分片
+    *p++ = (uint8_t)wnd;
+    *p++ = (uint8_t)(wnd >> 8);
+    p = kcp_encode32(p, ts);
+    p = kcp_encode32(p, sn);
+    p = kcp_encode32(p, kcp->rcv_nxt);
+    p = kcp_encode32(p, len);
+    return p;
+}
+
+void kcp_init(kcp_t *kcp, uint32_t conv, int (*output)(const uint8_t *, int, void *), void *user)
+{
+    memset(kcp, 0, sizeof(*kcp));
+    kcp->conv = conv;
+    kcp->rmt_wnd = KCP_WND;
+    kcp->rx_rto = KCP_RTO_DEF;
+    kcp->output = output;
+    kcp->user = user;
+}
+
+/**
+ * @brief 取出报文的会话号, 报文太短时返回0
+ */
+uint32_t kcp_peek_conv(const uint8_t *data, size_t size)
+{
+    return (size < KCP_OVERHEAD) ? 0 : kcp_decode32(data);
+}
+
+static void kcp_update_rtt(kcp_t *kcp, int32_t rtt)
+{
+    int32_t delta;
+    int32_t rto;
+
+    if (kcp->rx_srtt == 0)
+    {
+        kcp->rx_srtt = rtt;
+        kcp->rx_rttval = rtt / 2;
+    }
+    else
+    {
+        delta = (rtt > kcp->rx_srtt) ? rtt - kcp->rx_srtt : kcp->rx_srtt - rtt;
+        kcp->rx_rttval = (3 * kcp->rx_rttval + delta) / 4;
+        kcp->rx_srtt = (7 * kcp->rx_srtt + rtt) / 8;
+        if (kcp->rx_srtt < 1)
+        {
+            kcp->rx_srtt = 1;
+        }
+    }
+
+    rto = kcp->rx_srtt + ((4 * kcp->rx_rttval > KCP_INTERVAL) ? 4 * kcp->rx_rttval : KCP_INTERVAL);
+    if (rto < KCP_RTO_MIN)
+    {
+        rto = KCP_RTO_MIN;
+    }
+    if (rto > KCP_RTO_MAX)
+    {
+        rto = KCP_RTO_MAX;
+    }
+    kcp->rx_rto = rto;
+}
+
+// 已确认的段出窗口
+static void kcp_shrink(kcp_t *kcp)
+{
+    while (kcp_diff(kcp->snd_nxt, kcp->snd_una) > 0 && !kcp->snd[kcp->snd_una % KCP_WND].used)
+    {
+        kcp->snd_una++;
+    }
+}
+
+static void kcp_ack_one(kcp_t *kcp, uint32_t sn)
+{
+    if (kcp_diff(sn, kcp->snd_una) >= 0 && kcp_diff(sn, kcp->snd_nxt) < 0)
+    {
+        kcp->snd[sn % KCP_WND].used = 0;
+    }
+}
+
+static void kcp_ack_until(kcp_t *kcp, uint32_t una)
+{
+    if (kcp_diff(una, kcp->snd_nxt) > 0)
+    {
+        una = kcp->snd_nxt;
+    }
+
+    while (kcp_diff(una, kcp->snd_una) > 0)
+    {
+        kcp->snd[kcp->snd_una % KCP_WND].used = 0;
+        kcp->snd_una++;
+    }
+}
+
+// 比 sn 早发出而仍未确认的段被跨越一次
+static void kcp_ack_skip(kcp_t *kcp, uint32_t sn)
+{
+    for (uint32_t i = kcp->snd_una; kcp_diff(i, sn) < 0 && kcp_diff(i, kcp->snd_nxt) < 0; i++)
+    {
+        kcp_seg_t *seg = &kcp->snd[i % KCP_WND];
+        if (seg->used && seg->xmit > 0)
+        {
+            seg->fastack++;
+        }
+    }
+}
+
+/**
+ * @brief 处理收到的UDP报文
+ * @return 0 成功, 负数表示报文无效
+ */
+int kcp_input(kcp_t *kcp, const uint8_t *data, size_t size)
+{
+    uint32_t conv, ts, sn, una, len;
+    uint8_t cmd;
+    uint16_t wnd;
+
+    if (size < KCP_OVERHEAD)
+    {
+        return -1;
+    }
+
+    while (size >= KCP_OVERHEAD)
+    {
+        conv = kcp_decode32(data);
+        cmd = data[4];
+        wnd = (uint16_t)(data[6] | (data[7] << 8));
+        ts = kcp_decode32(data + 8);
+        sn = kcp_decode32(data + 12);
+        una = kcp_decode32(data + 16);
+        len = kcp_decode32(data + 20);
+        data += KCP_OVERHEAD;
+        size -= KCP_OVERHEAD;
+
+        if (conv != kcp->conv || len > size)
+        {
+            return -1;
+        }
+
+        kcp->rmt_wnd = wnd;
+        kcp_ack_until(kcp, una);
+
+        switch (cmd)
+        {
+        case KCP_CMD_ACK:
+            if (kcp_diff(kcp->current, ts) >= 0)
+            {
+                kcp_update_rtt(kcp, kcp_diff(kcp->current, ts));
+            }
+            kcp_ack_one(kcp, sn);
+            kcp_ack_skip(kcp, sn);
+            break;
+
+        case KCP_CMD_PUSH:
+            if (len > KCP_RX_MSS)
+            {
+                return -1;
+            }
+            // 窗口内的段都要确认, 重复段也确认, 以免对端一直重传
+            if (kcp_diff(sn, kcp->rcv_nxt + KCP_WND) < 0)
+            {
+                if (kcp->ack_count < KCP_WND * 2)
+                {
+                    kcp->ack_sn[kcp->ack_count] = sn;
+                    kcp->ack_ts[kcp->ack_count] = ts;
+                    kcp->ack_count++;
+                }
+
+                kcp_rcv_seg_t *seg = &kcp->rcv[sn % KCP_WND];
+                if (kcp_diff(sn, kcp->rcv_nxt) >= 0 && !seg->used)
+                {
+                    seg->sn = sn;
+                    seg->len = (uint16_t)len;
+                    memcpy(seg->data, data, len);
+                    seg->used = 1;
+                }
+            }
+            break;
+
+        case KCP_CMD_WASK:
+            kcp->probe |= KCP_ASK_TELL;
+            break;
+
+        case KCP_CMD_WINS:
+            break;
+
+        default:
+            return -1;
+        }
+
+        data += len;
+        size -= len;
+    }
+
+    kcp_shrink(kcp);
+    return 0;
+}
+
+/**
+ * @brief 按顺序读取已收到的数据
+ * @return 读取的字节数
+ */
+int kcp_recv(kcp_t *kcp, uint8_t *buf, size_t len)
+{
+    size_t total = 0;
+    uint32_t n;
+
+    while (total < len)
+    {
+        kcp_rcv_seg_t *seg = &kcp->rcv[kcp->rcv_nxt % KCP_WND];
+        if (!seg->used || seg->sn != kcp->rcv_nxt)
+        {
+            break;
+        }
+
+        n = seg->len - kcp->rcv_off;
+        if (n > len - total)
+        {
+            n = len - total;
+        }
+        memcpy(buf + total, seg->data + kcp->rcv_off, n);
+        total += n;
+        kcp->rcv_off += n;
+
+        if (kcp->rcv_off == seg->len)
+        {
+            seg->used = 0;
+            kcp->rcv_off = 0;
+            kcp->rcv_nxt++;
+        }
+    }
+
+    return (int)total;
+}
+
+/**
+ * @brief 数据放入发送窗口, 尚未发出的最后一段会被继续填充
+ * @return 放入的字节数, 窗口满时可能小于len
+ */
+int kcp_send(kcp_t *kcp, const uint8_t *buf, size_t len)
+{
+    size_t total = 0;
+    uint32_t n;
+
+    if (kcp_diff(kcp->snd_nxt, kcp->snd_una) > 0)
+    {
+        kcp_seg_t *last = &kcp->snd[(kcp->snd_nxt - 1) % KCP_WND];
+        if (last->used && last->xmit == 0 && last->len < KCP_MSS)
+        {
+            n = KCP_MSS - last->len;
+            if (n > len)
+            {
+                n = len;
+            }
+            memcpy(last->data + last->len, buf, n);
+            last->len += n;
+            total += n;
+        }
+    }
+
+    while (total < len && kcp_diff(kcp->snd_nxt, kcp->snd_una) < KCP_WND)
+    {
+        kcp_seg_t *seg = &kcp->snd[kcp->snd_nxt % KCP_WND];
+
+        n = len - total;
+        if (n > KCP_MSS)
+        {
+            n = KCP_MSS;
+        }
+
+        memset(seg, 0, offsetof(kcp_seg_t, data));
+        seg->sn = kcp->snd_nxt++;
+        seg->len = (uint16_t)n;
+        seg->used = 1;
+        memcpy(seg->data, buf + total, n);
+        total += n;
+    }
+
+    return (int)total;
+}
+
+// 缓冲区放不下 need 字节时先发出
+static uint8_t *kcp_reserve(kcp_t *kcp, uint8_t *p, uint32_t need)
+{
+    if (p - kcp->buffer + need > KCP_MTU)
+    {
+        kcp->output(kcp->buffer, p - kcp->buffer, kcp->user);
+        p = kcp->buffer;
+    }
+    return p;
+}
+
+/**
+ * @brief 发送ACK、窗口探测、新数据和需要重传的数据
+ *
+ * 应每 KCP_INTERVAL 调用一次, 放入新数据后也可立即调用以降低延迟
+ */
+void kcp_flush(kcp_t *kcp, uint32_t current)
+{
+    uint8_t *p = kcp->buffer;
+    uint32_t limit;
+    uint8_t send;
+
+    kcp->current = current;
+
+    for (uint32_t i = 0; i < kcp->ack_count; i++)
+    {
+        p = kcp_reserve(kcp, p, KCP_OVERHEAD);
+        p = kcp_encode_header(kcp, p, KCP_CMD_ACK, kcp->ack_ts[i], kcp->ack_sn[i], 0);
+    }
+    kcp->ack_count = 0;
+
+    // 对端窗口为0时定期询问
+    if (kcp->rmt_wnd == 0)
+    {
+        if (kcp->probe_wait == 0)
+        {
+            kcp->probe_wait = KCP_PROBE_INIT;
+            kcp->ts_probe = current + kcp->probe_wait;
+        }
+        else if (kcp_diff(current, kcp->ts_probe) >= 0)
+        {
+            kcp->probe_wait += kcp->probe_wait / 2;
+            if (kcp->probe_wait > KCP_PROBE_LIMIT)
+            {
+                kcp->probe_wait = KCP_PROBE_LIMIT;
+            }
+            kcp->ts_probe = current + kcp->probe_wait;
+            kcp->probe |= KCP_ASK_SEND;
+        }
+    }
+    else
+    {
+        kcp->probe_wait = 0;
+    }
+
+    if (kcp->probe & KCP_ASK_SEND)
+    {
+        p = kcp_reserve(kcp, p, KCP_OVERHEAD);
+        p = kcp_encode_header(kcp, p, KCP_CMD_WASK, current, 0, 0);
+    }
+    if (kcp->probe & KCP_ASK_TELL)
+    {
+        p = kcp_reserve(kcp, p, KCP_OVERHEAD);
+        p = kcp_encode_header(kcp, p, KCP_CMD_WINS, current, 0, 0);
+    }
+    kcp->probe = 0;
+
+    limit = kcp->snd_una + ((kcp->rmt_wnd < KCP_WND) ? kcp->rmt_wnd : KCP_WND);
+
+    for (uint32_t sn = kcp->snd_una; kcp_diff(sn, kcp->snd_nxt) < 0; sn++)
+    {
+        kcp_seg_t *seg = &kcp->snd[sn % KCP_WND];
+        send = 0;
+
+        if (!seg->used)
+        {
+            continue;
+        }
+
+        if (seg->xmit == 0)
+        {
+            // 首次发送受对端窗口限制
+            if (kcp_diff(sn, limit) >= 0)
+            {
+                break;
+            }
+            seg->rto = kcp->rx_rto;
+            send = 1;
+        }
+        else if (kcp_diff(current, seg->resendts) >= 0)
+        {
+            seg->rto += kcp->rx_rto / 2;
+            if (seg->rto > KCP_RTO_MAX)
+            {
+                seg->rto = KCP_RTO_MAX;
+            }
+            send = 1;
+        }
+        else if (seg->fastack >= KCP_FASTRESEND)
+        {
+            send = 1;
+        }
+
+        if (!send)
+        {
+            continue;
+        }
+
+        seg->xmit++;
+        seg->ts = current;
+        seg->resendts = current + seg->rto;
+        seg->fastack = 0;
+        if (seg->xmit >= KCP_DEADLINK)
+        {
+            kcp->dead = 1;
+        }
+
+        p = kcp_reserve(kcp, p, KCP_OVERHEAD + seg->len);
+        p = kcp_encode_header(kcp, p, KCP_CMD_PUSH, seg->ts, seg->sn, seg->len);
+        memcpy(p, seg->data, seg->len);
+        p += seg->len;
+    }
+
+    if (p > kcp->buffer)
+    {
+        kcp->output(kcp->buffer, p - kcp->buffer, kcp->user);
+    }
+}
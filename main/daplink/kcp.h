@@ -0,0 +1,98 @@
+#ifndef __KCP_H__
+#define __KCP_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief 可靠UDP传输 (ARQ)
+ *
+ * 报文格式与KCP相同(24字节小端头部: conv, cmd, frg, wnd, ts, sn, una, len),
+ * 以流模式工作, 可与按 nodelay/流模式配置的KCP对端通信。
+ * 段按序号存放在固定数组中, 不需要动态内存。
+ */
+
+#define KCP_OVERHEAD    24
+#define KCP_MTU         576                         // 发出的UDP报文最大长度
+#define KCP_MSS         (KCP_MTU - KCP_OVERHEAD)    // 发出的段最大数据长度
+// 接收按WiFi的 MTU_SIZE 准备, 对端按标准KCP默认的 mtu 1400 发送也能接收
+#define KCP_RX_MTU      1500                            // 接收的UDP报文最大长度
+#define KCP_RX_MSS      (KCP_RX_MTU - KCP_OVERHEAD)     // 接收的段最大数据长度
+
+/* 调优参数, 面向低延迟的单步调试流量 */
+#define KCP_WND         16      // 收发窗口(段数)
+#define KCP_INTERVAL    10      // 刷新间隔(ms)
+#define KCP_RTO_MIN     10      // 最小重传超时(ms)
+#define KCP_RTO_DEF     100     // RTT未知时的重传超时(ms)
+#define KCP_RTO_MAX     2000    // 最大重传超时(ms)
+#define KCP_FASTRESEND  2       // 被后续段跨越多少次即快速重传
+#define KCP_DEADLINK    20      // 同一段重传多少次视为链路断开
+#define KCP_PROBE_INIT  500     // 对端窗口为0时首次探测等待(ms)
+#define KCP_PROBE_LIMIT 5000    // 探测等待上限(ms)
+
+typedef struct
+{
+    uint32_t sn;
+    uint32_t ts;            // 最近一次发送的时间
+    uint32_t resendts;      // 超时重传时间
+    uint32_t rto;
+    uint32_t fastack;       // 被后续段的ACK跨越的次数
+    uint32_t xmit;          // 发送次数, 0表示尚未发送
+    uint16_t len;
+    uint8_t used;           // 未确认
+    uint8_t data[KCP_MSS];
+} kcp_seg_t;
+
+typedef struct
+{
+    uint32_t sn;
+    uint16_t len;
+    uint8_t used;           // 已收到未读取
+    uint8_t data[KCP_RX_MSS];
+} kcp_rcv_seg_t;
+
+typedef struct
+{
+    uint32_t conv;          // 会话号, 由对端选定
+    uint32_t current;       // 当前时间(ms)
+    uint8_t dead;           // 链路断开
+
+    /* 发送: [snd_una, snd_nxt) 中的段位于 snd[sn % KCP_WND] */
+    uint32_t snd_una;
+    uint32_t snd_nxt;
+    uint32_t rmt_wnd;       // 对端接收窗口
+    kcp_seg_t snd[KCP_WND];
+
+    /* 接收: [rcv_nxt, rcv_nxt + KCP_WND) 中的段位于 rcv[sn % KCP_WND] */
+    uint32_t rcv_nxt;
+    uint32_t rcv_off;       // rcv_nxt 段已读取的字节数
+    kcp_rcv_seg_t rcv[KCP_WND];
+
+    /* 待发送的ACK */
+    uint32_t ack_sn[KCP_WND * 2];
+    uint32_t ack_ts[KCP_WND * 2];
+    uint32_t ack_count;
+
+    /* RTT估计 */
+    int32_t rx_srtt;
+    int32_t rx_rttval;
+    int32_t rx_rto;
+
+    /* 窗口探测 */
+    uint8_t probe;
+    uint32_t probe_wait;
+    uint32_t ts_probe;
+
+    int (*output)(const uint8_t *buf, int len, void *user);
+    void *user;
+    uint8_t buffer[KCP_MTU];    // 组包缓冲区
+} kcp_t;
+
+void kcp_init(kcp_t *kcp, uint32_t conv, int (*output)(const uint8_t *, int, void *), void *user);
+int kcp_input(kcp_t *kcp, const uint8_t *data, size_t size);
+int kcp_recv(kcp_t *kcp, uint8_t *buf, size_t len);
+int kcp_send(kcp_t *kcp, const uint8_t *buf, size_t len);
+void kcp_flush(kcp_t *kcp, uint32_t current);
+uint32_t kcp_peek_conv(const uint8_t *data, size_t size);
+
+#endif
@@ -0,0 +1,328 @@
+/**
+ * @file kcp_server.c
+ * @brief 基于UDP的可靠传输服务器, 替代TCP承载USBIP/elaphureLink数据
+ *
+ * 同一时间只服务一个对端, 会话号(conv)由对端选定。
+ * 收到新会话号的报文即开始新会话; 当前会话期间其他对端的报文被丢弃,
+ * 除非当前会话已长时间没有报文。
+ * 重组出的消息交给 tcp_server_dispatch() 处理, 与TCP方式相同。
+ */
+
+/* 标准库头文件 */
+#include <string.h>
+#include <stdint.h>
+#include <sys/param.h>
+#include <sys/select.h>
+
+/* 项目相关头文件 */
+#include "wifi/wifi_configuration.h"  // WiFi配置
+#include "usbip_server.h"       // USBIP服务器
+#include "DAP_handle.h"         // DAP处理
+#include "tcp_stream.h"         // 消息重组
+#include "tcp_server.h"         // 消息分发
+#include "kcp.h"
+#include "kcp_server.h"
+
+/* elaphureLink协议头文件 */
+#include "components/elaphureLink/elaphureLink_protocol.h"
+
+/* FreeRTOS相关头文件 */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+/* lwIP网络协议栈头文件 */
+#include "lwip/err.h"
+#include "lwip/sockets.h"
+#include "lwip/sys.h"
+
+/* 外部变量声明 */
+extern TaskHandle_t kDAPTaskHandle;  // DAP任务句柄
+extern int kRestartDAPHandle;        // DAP重启标志
+extern uint8_t kState;               // 连接状态, 定义于tcp_server.c
+extern int kSock;                    // 当前会话使用的Socket
+
+/* 当前会话多久没有报文后允许其他对端接管 */
+#define KCP_SESSION_IDLE_MS 10000
+
+/* 发送窗口满时等待对端确认的最长时间 */
+#define KCP_SEND_WAIT_MS 1000
+
+static kcp_t kcp;
+static SemaphoreHandle_t kcp_mux;
+static StaticSemaphore_t kcp_mux_buffer;
+static TaskHandle_t kcp_task_handle;
+
+static int kcp_sock = -1;
+static struct sockaddr_in kcp_peer;          // 当前会话的对端地址
+static uint8_t kcp_connected;
+static TickType_t kcp_last_recv;             // 最近一次收到报文的时间
+
+static tcp_stream_t kcp_rx_stream;           // 接收重组缓冲区
+static uint8_t kcp_rx_buf[KCP_RX_MTU];
+
+static uint32_t kcp_now(void)
+{
+    return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+// kcp_flush() 组好的报文发给对端
+static int kcp_server_output(const uint8_t *buf, int len, void *user)
+{
+    return sendto(kcp_sock, buf, len, 0, (struct sockaddr *)&kcp_peer, sizeof(kcp_peer));
+}
+
+/**
+ * @brief 发送数据
+ *
+ * 窗口满时等待对端确认, 超时或会话结束返回错误。
+ * 在服务器任务中调用时无法等待(确认由本任务接收), 窗口不足即失败。
+ *
+ * @param flags MSG_MORE 表示消息还有后续部分, 暂不发出
+ * @return 发送字节数, 负数表示失败
+ */
+int kcp_server_send(const void *data, size_t size, int flags)
+{
+    const uint8_t *p = data;
+    size_t sent = 0;
+    TickType_t start = xTaskGetTickCount();
+
+    while (1)
+    {
+        xSemaphoreTake(kcp_mux, portMAX_DELAY);
+        if (!kcp_connected || kcp.dead)
+        {
+            xSemaphoreGive(kcp_mux);
+            return -1;
+        }
+        sent += kcp_send(&kcp, p + sent, size - sent);
+        if (sent < size || !(flags & MSG_MORE))
+        {
+            kcp_flush(&kcp, kcp_now());
+        }
+        xSemaphoreGive(kcp_mux);
+
+        if (sent == size)
+        {
+            return (int)size;
+        }
+
+        if (xTaskGetCurrentTaskHandle() == kcp_task_handle ||
+            (xTaskGetTickCount() - start) > pdMS_TO_TICKS(KCP_SEND_WAIT_MS))
+        {
+            os_printf("kcp send window full\r\n");
+            return -1;
+        }
+        vTaskDelay(1);
+    }
+}
+
+/**
+ * @brief 结束当前会话并释放DAP
+ */
+static void kcp_server_close(void)
+{
+    if (!kcp_connected)
+    {
+        return;
+    }
+
+    os_printf("KCP session %u closed\r\n", (unsigned)kcp.conv);
+
+    xSemaphoreTake(kcp_mux, portMAX_DELAY);
+    kcp_connected = 0;
+    xSemaphoreGive(kcp_mux);
+
+    kSock = -1;
+    kState = ACCEPTING;
+
+    kRestartDAPHandle = RESET_HANDLE;
+    if (kDAPTaskHandle)
+        xTaskNotifyGive(kDAPTaskHandle);
+}
+
+/**
+ * @brief 以对端的会话号开始新会话
+ */
+static void kcp_server_open(const struct sockaddr_in *peer, uint32_t conv)
+{
+    char addr_str[16];
+
+    kcp_server_close();
+
+    inet_ntoa_r(peer->sin_addr, addr_str, sizeof(addr_str) - 1);
+    os_printf("KCP session %u from %s\r\n", (unsigned)conv, addr_str);
+
+    xSemaphoreTake(kcp_mux, portMAX_DELAY);
+    kcp_init(&kcp, conv, kcp_server_output, NULL);
+    kcp_peer = *peer;
+    kcp_connected = 1;
+    xSemaphoreGive(kcp_mux);
+
+    tcp_stream_reset(&kcp_rx_stream);
+    kSock = kcp_sock;
+    kState = ACCEPTING;
+}
+
+/**
+ * @brief 取出已按序到达的数据, 逐条处理完整消息
+ * @return 0 正常, 负数表示数据流错乱, 会话应结束
+ */
+static int kcp_server_process(void)
+{
+    uint8_t *msg;
+    uint32_t msg_len;
+    uint32_t space;
+    int len;
+    int ret;
+
+    while ((space = tcp_stream_space(&kcp_rx_stream)) > 0)
+    {
+        xSemaphoreTake(kcp_mux, portMAX_DELAY);
+        len = kcp_recv(&kcp, kcp_rx_buf, MIN(space, sizeof(kcp_rx_buf)));
+        xSemaphoreGive(kcp_mux);
+
+        if (len <= 0)
+        {
+            break;
+        }
+        tcp_stream_push(&kcp_rx_stream, kcp_rx_buf, len);
+
+        while ((ret = tcp_stream_next(&kcp_rx_stream, kState, &msg, &msg_len)) > 0)
+        {
+            tcp_server_dispatch(msg, msg_len);
+        }
+
+        if (ret < 0)
+        {
+            os_printf("Stream out of sync, dropping session\r\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 处理收到的一个UDP报文
+ */
+static void kcp_server_input(const struct sockaddr_in *peer, int len)
+{
+    uint32_t conv;
+    int same_peer;
+    int ret;
+
+    if (len < KCP_OVERHEAD)
+    {
+        return;
+    }
+
+    conv = kcp_peek_conv(kcp_rx_buf, len);
+    same_peer = kcp_connected &&
+                peer->sin_addr.s_addr == kcp_peer.sin_addr.s_addr &&
+                peer->sin_port == kcp_peer.sin_port;
+
+    if (!same_peer || conv != kcp.conv)
+    {
+        // 其他对端只能在当前会话空闲后接管
+        if (kcp_connected && !same_peer &&
+            (xTaskGetTickCount() - kcp_last_recv) < pdMS_TO_TICKS(KCP_SESSION_IDLE_MS))
+        {
+            return;
+        }
+        kcp_server_open(peer, conv);
+    }
+
+    kcp_last_recv = xTaskGetTickCount();
+
+    xSemaphoreTake(kcp_mux, portMAX_DELAY);
+    ret = kcp_input(&kcp, kcp_rx_buf, len);
+    xSemaphoreGive(kcp_mux);
+
+    if (ret < 0 || kcp_server_process() < 0)
+    {
+        kcp_server_close();
+    }
+}
+
+/**
+ * @brief KCP服务器主任务函数
+ * @param pvParameters FreeRTOS任务参数(未使用)
+ */
+void kcp_server_task(void *pvParameters)
+{
+    struct sockaddr_in addr;
+    struct sockaddr_in peer;
+    socklen_t peer_len;
+    struct timeval tv;
+    fd_set rfds;
+    int len;
+
+    usbip_server_init();
+    kcp_mux = xSemaphoreCreateMutexStatic(&kcp_mux_buffer);
+    kcp_task_handle = xTaskGetCurrentTaskHandle();
+
+    kcp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (kcp_sock < 0)
+    {
+        os_printf("Unable to create socket: errno %d\r\n", errno);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    if (bind(kcp_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        os_printf("Socket unable to bind: errno %d\r\n", errno);
+        close(kcp_sock);
+        vTaskDelete(NULL);
+        return;
+    }
+    os_printf("KCP server listening on UDP %d\r\n", PORT);
+
+    while (1)
+    {
+        FD_ZERO(&rfds);
+        FD_SET(kcp_sock, &rfds);
+        tv.tv_sec = 0;
+        tv.tv_usec = KCP_INTERVAL * 1000;
+
+        if (select(kcp_sock + 1, &rfds, NULL, NULL, &tv) < 0)
+        {
+            os_printf("select failed: errno %d\r\n", errno);
+            vTaskDelay(pdMS_TO_TICKS(KCP_INTERVAL));
+            continue;
+        }
+
+        /* 处理所有已到达的报文 */
+        while (FD_ISSET(kcp_sock, &rfds))
+        {
+            peer_len = sizeof(peer);
+            len = recvfrom(kcp_sock, kcp_rx_buf, sizeof(kcp_rx_buf), MSG_DONTWAIT,
+                           (struct sockaddr *)&peer, &peer_len);
+            if (len < 0)
+            {
+                break;
+            }
+            kcp_server_input(&peer, len);
+        }
+
+        if (!kcp_connected)
+        {
+            continue;
+        }
+
+        /* 定时发送ACK、重传和窗口探测 */
+        xSemaphoreTake(kcp_mux, portMAX_DELAY);
+        kcp_flush(&kcp, kcp_now());
+        xSemaphoreGive(kcp_mux);
+
+        /* 接收缓冲区腾出空间后继续取数据 */
+        if (kcp_server_process() < 0 || kcp.dead)
+        {
+            kcp_server_close();
+        }
+    }
+}
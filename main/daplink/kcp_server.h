@@ -0,0 +1,9 @@
+#ifndef __KCP_SERVER_H__
+#define __KCP_SERVER_H__
+
+#include <stddef.h>
+
+void kcp_server_task(void *pvParameters);
+int kcp_server_send(const void *data, size_t size, int flags);
+
+#endif
@@ -0,0 +1,276 @@
+/**
+ * @file tcp_netconn.c
+ * @brief 基于lwIP netconn接口的TCP服务器, 绕过BSD socket层
+ *
+ * 接收的netbuf中已完整的消息直接原地交给 tcp_server_dispatch() 处理,
+ * 不再拷贝到接收缓冲区; 跨越pbuf边界或起点未4字节对齐的消息经 tcp_stream 重组。
+ * 同一时间只服务一个连接, 其余连接在listen队列中等待。
+ */
+
+/* 标准库头文件 */
+#include <string.h>
+#include <stdint.h>
+
+/* 项目相关头文件 */
+#include "wifi/wifi_configuration.h"  // WiFi配置
+#include "usbip_server.h"       // USBIP服务器
+#include "DAP_handle.h"         // DAP处理
+#include "tcp_stream.h"         // 消息重组
+#include "tcp_server.h"         // 消息分发
+#include "tcp_netconn.h"
+
+/* elaphureLink协议头文件 */
+#include "components/elaphureLink/elaphureLink_protocol.h"
+
+/* FreeRTOS相关头文件 */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+/* lwIP网络协议栈头文件 */
+#include "lwip/api.h"
+#include "lwip/tcp.h"
+#include "lwip/tcpip.h"
+#include "lwip/sockets.h"
+
+/* 外部变量声明 */
+extern TaskHandle_t kDAPTaskHandle;  // DAP任务句柄
+extern int kRestartDAPHandle;        // DAP重启标志
+extern uint8_t kState;               // 连接状态, 定义于tcp_server.c
+extern int kSock;                    // netconn方式下仅表示是否有连接
+
+/* TCP保活: 空闲5秒后每秒探测一次, 连续3次无响应即断开 */
+#define TCP_NETCONN_KEEPALIVE_IDLE_MS  5000
+#define TCP_NETCONN_KEEPALIVE_INTVL_MS 1000
+#define TCP_NETCONN_KEEPALIVE_COUNT    3
+
+static struct netconn *netconn_client;       // 当前连接, NULL表示无连接
+static SemaphoreHandle_t netconn_mux;        // 保护netconn_client, 发送与关闭互斥
+static StaticSemaphore_t netconn_mux_buffer;
+static tcp_stream_t netconn_rx_stream;       // 跨pbuf消息的重组缓冲区
+
+/**
+ * @brief 发送数据
+ *
+ * 回复数据所在的缓冲区发送后立即复用, 因此由lwIP拷贝到发送pbuf(NETCONN_COPY)
+ *
+ * @param flags MSG_MORE 表示消息还有后续部分
+ * @return 发送字节数, 负数表示连接已不可用
+ */
+int tcp_netconn_send(const void *data, size_t size, int flags)
+{
+    uint8_t apiflags = NETCONN_COPY;
+    err_t err = ERR_CONN;
+
+    if (flags & MSG_MORE)
+    {
+        apiflags |= NETCONN_MORE;
+    }
+
+    xSemaphoreTake(netconn_mux, portMAX_DELAY);
+    if (netconn_client != NULL)
+    {
+        err = netconn_write(netconn_client, data, size, apiflags);
+    }
+    xSemaphoreGive(netconn_mux);
+
+    if (err != ERR_OK)
+    {
+        os_printf("netconn write failed: %d\r\n", err);
+        return -1;
+    }
+
+    return (int)size;
+}
+
+/**
+ * @brief 处理一段接收数据
+ *
+ * 重组缓冲区为空时, 段内完整的消息原地处理, 只有末尾的半条消息需要拷贝。
+ * 消息头会按字访问, 起点未4字节对齐时改走 tcp_stream, 由它交出对齐的消息。
+ *
+ * @return 0 正常, 负数表示数据流错乱, 连接应关闭
+ */
+static int tcp_netconn_input(uint8_t *data, uint32_t len)
+{
+    uint8_t *msg;
+    uint32_t msg_len;
+    uint32_t n;
+    int ret;
+
+    while (len > 0)
+    {
+        if (netconn_rx_stream.start == netconn_rx_stream.end)
+        {
+            while (((uintptr_t)data & 3) == 0 &&
+                   (msg_len = tcp_stream_message_length(kState, data, len)) > 0 && msg_len <= len)
+            {
+                tcp_server_dispatch(data, msg_len);
+                data += msg_len;
+                len -= msg_len;
+            }
+
+            if (len == 0)
+            {
+                break;
+            }
+        }
+
+        n = tcp_stream_push(&netconn_rx_stream, data, len);
+        data += n;
+        len -= n;
+
+        while ((ret = tcp_stream_next(&netconn_rx_stream, kState, &msg, &msg_len)) > 0)
+        {
+            tcp_server_dispatch(msg, msg_len);
+        }
+
+        if (ret < 0)
+        {
+            os_printf("Stream out of sync, dropping connection\r\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 禁用Nagle并设置保活参数, pcb只能在tcpip线程中修改
+ */
+static void tcp_netconn_setup_pcb(void *ctx)
+{
+    struct netconn *conn = (struct netconn *)ctx;
+    struct tcp_pcb *pcb = conn->pcb.tcp;
+
+    // 对端已复位, pcb已释放
+    if (pcb == NULL)
+    {
+        return;
+    }
+
+    tcp_nagle_disable(pcb);
+    pcb->so_options |= SOF_KEEPALIVE;
+    pcb->keep_idle = TCP_NETCONN_KEEPALIVE_IDLE_MS;
+    pcb->keep_intvl = TCP_NETCONN_KEEPALIVE_INTVL_MS;
+    pcb->keep_cnt = TCP_NETCONN_KEEPALIVE_COUNT;
+}
+
+/**
+ * @brief 新连接取得DAP
+ */
+static void tcp_netconn_open(struct netconn *conn)
+{
+    os_printf("Netconn accepted\r\n");
+
+    // 先于之后的netconn_close/delete消息在tcpip线程执行, conn此时仍然有效
+    tcpip_callback(tcp_netconn_setup_pcb, conn);
+
+    tcp_stream_reset(&netconn_rx_stream);
+    kState = ACCEPTING;
+    kSock = 0;
+
+    xSemaphoreTake(netconn_mux, portMAX_DELAY);
+    netconn_client = conn;
+    xSemaphoreGive(netconn_mux);
+}
+
+/**
+ * @brief 关闭连接并释放DAP
+ */
+static void tcp_netconn_close(void)
+{
+    struct netconn *conn;
+
+    os_printf("Shutting down netconn and restarting...\r\n");
+
+    xSemaphoreTake(netconn_mux, portMAX_DELAY);
+    conn = netconn_client;
+    netconn_client = NULL;
+    xSemaphoreGive(netconn_mux);
+
+    netconn_close(conn);
+    netconn_delete(conn);
+    kSock = -1;
+
+    /* 重置连接状态 */
+    kState = ACCEPTING;
+
+    /* 重启DAP任务 */
+    kRestartDAPHandle = RESET_HANDLE;
+    if (kDAPTaskHandle)
+        xTaskNotifyGive(kDAPTaskHandle);
+}
+
+/**
+ * @brief netconn服务器主任务函数
+ * @param pvParameters FreeRTOS任务参数(未使用)
+ */
+void tcp_netconn_task(void *pvParameters)
+{
+    struct netconn *listen_conn;
+    struct netconn *conn;
+    struct netbuf *nb;
+    void *data;
+    u16_t len;
+    err_t err;
+
+    usbip_server_init();
+    netconn_mux = xSemaphoreCreateMutexStatic(&netconn_mux_buffer);
+
+    listen_conn = netconn_new(NETCONN_TCP);
+    if (listen_conn == NULL)
+    {
+        os_printf("Unable to create netconn\r\n");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    if (netconn_bind(listen_conn, IP_ADDR_ANY, PORT) != ERR_OK ||
+        netconn_listen(listen_conn) != ERR_OK)
+    {
+        os_printf("Netconn unable to listen\r\n");
+        netconn_delete(listen_conn);
+        vTaskDelete(NULL);
+        return;
+    }
+    os_printf("Netconn listening\r\n");
+
+    while (1)
+    {
+        if (netconn_accept(listen_conn, &conn) != ERR_OK)
+        {
+            continue;
+        }
+
+        tcp_netconn_open(conn);
+
+        /* 逐个处理收到的netbuf, 每个netbuf可能由多个pbuf组成 */
+        while ((err = netconn_recv(conn, &nb)) == ERR_OK)
+        {
+            do
+            {
+                netbuf_data(nb, &data, &len);
+                err = tcp_netconn_input(data, len) < 0 ? ERR_ABRT : ERR_OK;
+            } while (err == ERR_OK && netbuf_next(nb) >= 0);
+
+            netbuf_delete(nb);
+
+            if (err != ERR_OK)
+            {
+                break;
+            }
+        }
+
+        if (err == ERR_CLSD)
+        {
+            os_printf("Connection closed\r\n");
+        }
+        else
+        {
+            os_printf("netconn recv failed: %d\r\n", err);
+        }
+
+        tcp_netconn_close();
+    }
+}
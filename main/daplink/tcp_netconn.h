@@ -0,0 +1,9 @@
+#ifndef __TCP_NETCONN_H__
+#define __TCP_NETCONN_H__
+
+#include <stddef.h>
+
+void tcp_netconn_task(void *pvParameters);
+int tcp_netconn_send(const void *data, size_t size, int flags);
+
+#endif
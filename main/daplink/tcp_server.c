@@ -12,11 +12,16 @@
 #include <string.h>
 #include <stdint.h>
 #include <sys/param.h>
+#include <sys/select.h>
+#include <fcntl.h>
 
 /* 项目相关头文件 */
 #include "wifi/wifi_configuration.h"  // WiFi配置
 #include "usbip_server.h"       // USBIP服务器
 #include "DAP_handle.h"         // DAP处理
+#include "tcp_stream.h"         // TCP消息重组
+#include "tcp_tx.h"             // TCP发送队列
+#include "tcp_server.h"
 
 /* elaphureLink协议头文件 */
 #include "components/elaphureLink/elaphureLink_protocol.h"
@@ -43,9 +48,336 @@
 extern TaskHandle_t kDAPTaskHandle;  // DAP任务句柄,用于任务间通信
 extern int kRestartDAPHandle;        // DAP重启标志,控制DAP任务的重启
 
+/* 没有待发送数据时也定期醒来, 发送其他任务入队后未能发出的数据 */
+#define TCP_SERVER_POLL_MS 10
+
+/* 等待中的连接最多缓存的数据, 足够放下首个attach请求或握手 */
+#define TCP_SESSION_PENDING_SIZE 64
+
+/* 等待DAP的最长时间, 超时回复忙并断开 */
+#define TCP_SESSION_WAIT_MS 10000
+
+/* TCP保活: 空闲5秒后每秒探测一次, 连续3次无响应即断开, 尽快清除半开连接 */
+#define TCP_KEEPALIVE_IDLE  5
+#define TCP_KEEPALIVE_INTVL 1
+#define TCP_KEEPALIVE_COUNT 3
+
+/**
+ * @brief 等待DAP的连接
+ *
+ * 同一时间只有一个连接拥有DAP, 其状态和socket即 kState/kSock。
+ * 其他连接在此等待, 收到的数据先缓存, 拥有者断开后最早的等待者接管;
+ * 等待超时则回复忙并断开。
+ */
+typedef struct
+{
+    int sock;                                   // -1 表示空闲
+    TickType_t since;                           // 开始等待的时间
+    uint8_t pending[TCP_SESSION_PENDING_SIZE];  // 等待期间收到的数据
+    uint32_t pending_len;
+} tcp_session_t;
+
 /* 全局变量定义 */
-uint8_t kState = ACCEPTING;          // 当前连接状态,初始为等待连接状态
-int kSock = -1;                      // 当前活动的Socket描述符
+uint8_t kState = ACCEPTING;          // 拥有DAP的连接的状态,无连接时为等待连接状态
+int kSock = -1;                      // 拥有DAP的连接的Socket描述符
+
+static tcp_stream_t tcp_rx_stream;   // TCP接收重组缓冲区
+static tcp_tx_t tcp_tx;              // TCP发送队列
+static tcp_session_t tcp_sessions[MAX_CLIENTS - 1]; // 等待DAP的连接
+
+/**
+ * @brief 通过连接的发送队列发送数据
+ * @param flags MSG_MORE 表示消息还有后续部分
+ * @return 入队字节数, 负数表示连接已不可用
+ */
+int tcp_server_send(int s, const void *data, size_t size, int flags)
+{
+    if (s != tcp_tx.sock)
+    {
+        return -1;
+    }
+    return tcp_tx_queue(&tcp_tx, data, size, flags);
+}
+
+/**
+ * @brief 发送控制消息(unlink回复等), 优先于排队中的普通数据
+ */
+int tcp_server_send_ctrl(int s, const void *data, size_t size)
+{
+    if (s != tcp_tx.sock)
+    {
+        return -1;
+    }
+    return tcp_tx_queue_ctrl(&tcp_tx, data, size);
+}
+
+/**
+ * @brief 按当前连接状态处理一条完整消息
+ * @param buffer 消息数据
+ * @param len 消息长度
+ */
+void tcp_server_dispatch(uint8_t *buffer, uint32_t len)
+{
+    switch (kState)
+    {
+    case ACCEPTING:
+        kState = ATTACHING;    // 更新状态为正在连接
+        // fallthrough         // 继续执行ATTACHING的处理
+    case ATTACHING:
+        /* 尝试elaphureLink协议握手 */
+        if (el_handshake_process(kSock, buffer, len) == 0) {
+            // 握手成功,切换到elaphureLink数据传输阶段
+            kState = EL_DATA_PHASE;
+            break;
+        }
+
+        /* 如果不是elaphureLink协议,则按USBIP协议处理 */
+        attach(buffer, len);
+        break;
+
+    case EMULATING:
+        /* USBIP协议数据传输阶段 */
+        emulate(buffer, len);
+        break;
+
+    case EL_DATA_PHASE:
+        /* elaphureLink协议数据传输阶段 */
+        el_dap_data_process(buffer, len);
+        break;
+
+    default:
+        os_printf("unkonw kstate!\r\n");
+    }
+}
+
+/**
+ * @brief 设置已接受连接的Socket选项: 保活、禁用Nagle、非阻塞
+ */
+static void tcp_server_setup_socket(int sock)
+{
+    int on = 1;
+    int idle = TCP_KEEPALIVE_IDLE;
+    int intvl = TCP_KEEPALIVE_INTVL;
+    int count = TCP_KEEPALIVE_COUNT;
+
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (void *)&on, sizeof(on));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, (void *)&idle, sizeof(idle));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, (void *)&intvl, sizeof(intvl));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, (void *)&count, sizeof(count));
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (void *)&on, sizeof(on));
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+}
+
+/**
+ * @brief 处理拥有者连接中已完整到达的消息
+ * @return 0 正常, 负数表示连接应关闭
+ */
+static int tcp_server_process(void)
+{
+    uint8_t *msg;                    // 重组出的完整消息
+    uint32_t msg_len;                // 消息长度
+    int ret;
+
+    /* 逐条处理已完整到达的消息, 剩余部分等待后续数据
+     * 处理期间暂缓发送, 这一批产生的回复合并发出 */
+    tcp_tx_cork(&tcp_tx, 1);
+    while ((ret = tcp_stream_next(&tcp_rx_stream, kState, &msg, &msg_len)) > 0)
+    {
+        tcp_server_dispatch(msg, msg_len);
+    }
+
+    if (ret < 0)
+    {
+        os_printf("Stream out of sync, dropping connection\r\n");
+        return -1;
+    }
+
+    if (tcp_tx_cork(&tcp_tx, 0) < 0)
+    {
+        os_printf("send failed: errno %d\r\n", errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 连接取得DAP, data为等待期间缓存的数据
+ */
+static int tcp_server_open(int sock, const uint8_t *data, uint32_t len)
+{
+    os_printf("Socket %d owns the DAP\r\n", sock);
+
+    kSock = sock;
+    kState = ACCEPTING;
+    tcp_stream_reset(&tcp_rx_stream);
+    tcp_stream_push(&tcp_rx_stream, data, len);
+    tcp_tx_reset(&tcp_tx, sock);
+
+    return tcp_server_process();
+}
+
+/**
+ * @brief 关闭拥有DAP的连接并释放DAP
+ */
+static void tcp_server_close(void)
+{
+    if (kSock == -1)
+    {
+        return;
+    }
+
+    os_printf("Shutting down socket and restarting...\r\n");
+    tcp_tx_reset(&tcp_tx, -1);    // 丢弃未发送的数据
+    close(kSock);    // 关闭Socket
+    kSock = -1;
+
+    /* 重置连接状态 */
+    kState = ACCEPTING;
+
+    /* 重启DAP任务 */
+    kRestartDAPHandle = RESET_HANDLE;
+    if (kDAPTaskHandle)
+        xTaskNotifyGive(kDAPTaskHandle);
+}
+
+/**
+ * @brief 拒绝等待超时的连接: USBIP请求回复忙, 其他直接断开
+ */
+static void tcp_session_reject(tcp_session_t *session)
+{
+    usbip_stage1_header *req = (usbip_stage1_header *)session->pending;
+    usbip_stage1_header header;
+
+    if (session->pending_len >= sizeof(usbip_stage1_header) && ntohs(req->version) == USBIP_VERSION)
+    {
+        header.version = htons(USBIP_VERSION);
+        header.command = htons(ntohs(req->command) & 0xFF);
+        header.status = htonl(USBIP_ST_DEV_BUSY);
+        send(session->sock, &header, sizeof(header), MSG_DONTWAIT);
+    }
+
+    os_printf("Socket %d rejected, DAP busy\r\n", session->sock);
+    close(session->sock);
+    session->sock = -1;
+}
+
+/**
+ * @brief 新连接进入等待队列, 队列满时直接断开
+ */
+static void tcp_session_add(int sock)
+{
+    for (int i = 0; i < MAX_CLIENTS - 1; i++)
+    {
+        if (tcp_sessions[i].sock == -1)
+        {
+            tcp_sessions[i].sock = sock;
+            tcp_sessions[i].since = xTaskGetTickCount();
+            tcp_sessions[i].pending_len = 0;
+            os_printf("Socket %d waiting for the DAP\r\n", sock);
+            return;
+        }
+    }
+
+    os_printf("Too many connections, socket %d closed\r\n", sock);
+    close(sock);
+}
+
+/**
+ * @brief 接收等待中连接的数据, 连接已断开或数据超出缓存时释放
+ */
+static void tcp_session_recv(tcp_session_t *session)
+{
+    int len;
+
+    if (session->pending_len == TCP_SESSION_PENDING_SIZE)
+    {
+        tcp_session_reject(session);
+        return;
+    }
+
+    len = recv(session->sock, &session->pending[session->pending_len],
+               TCP_SESSION_PENDING_SIZE - session->pending_len, 0);
+    if (len > 0)
+    {
+        session->pending_len += len;
+    }
+    else if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        close(session->sock);
+        session->sock = -1;
+    }
+}
+
+/**
+ * @brief DAP空闲时由等待最久的连接接管
+ */
+static void tcp_session_promote(void)
+{
+    tcp_session_t *oldest = NULL;
+
+    for (int i = 0; i < MAX_CLIENTS - 1; i++)
+    {
+        if (tcp_sessions[i].sock != -1 &&
+            (oldest == NULL || (int32_t)(tcp_sessions[i].since - oldest->since) < 0))
+        {
+            oldest = &tcp_sessions[i];
+        }
+    }
+
+    if (oldest == NULL)
+    {
+        return;
+    }
+
+    int sock = oldest->sock;
+    oldest->sock = -1;
+    if (tcp_server_open(sock, oldest->pending, oldest->pending_len) < 0)
+    {
+        tcp_server_close();
+    }
+}
+
+/**
+ * @brief 处理拥有者连接的读写事件
+ * @return 0 正常, 负数表示连接应关闭
+ */
+static int tcp_server_poll(int readable)
+{
+    /* 发送积压数据 */
+    if (tcp_tx_flush(&tcp_tx) < 0)
+    {
+        os_printf("send failed: errno %d\r\n", errno);
+        return -1;
+    }
+
+    if (!readable)
+    {
+        return 0;
+    }
+
+    /* 接收数据, 一次可能收到多条消息或半条消息 */
+    int len = tcp_stream_recv(&tcp_rx_stream, kSock);
+
+    /* 接收错误处理 */
+    if (len < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return 0;
+        }
+        os_printf("recv failed: errno %d\r\n", errno);
+        return -1;
+    }
+    /* 连接关闭处理 */
+    else if (len == 0)
+    {
+        os_printf("Connection closed\r\n");
+        return -1;
+    }
+
+    return tcp_server_process();
+}
 
 /**
  * @brief TCP服务器主任务函数
@@ -54,12 +386,22 @@ int kSock = -1;                      // 当前活动的Socket描述符
  */
 void tcp_server_task(void *pvParameters)
 {
-    uint8_t tcp_rx_buffer[1500];     // TCP数据接收缓冲区
+    int ret;
+    int max_fd;
+    fd_set rfds, wfds;               // select()等待的读/写事件
+    struct timeval tv;
     char addr_str[128];              // IP地址字符串缓冲区
     int addr_family;                 // 地址族(IPv4/IPv6)
     int ip_protocol;                 // IP协议类型
     int on = 1;                      // Socket选项开关值
 
+    usbip_server_init();
+    tcp_tx_init(&tcp_tx);
+    for (int i = 0; i < MAX_CLIENTS - 1; i++)
+    {
+        tcp_sessions[i].sock = -1;
+    }
+
     while (1) // 主循环,用于服务器重启
     {
         /* IPv4/IPv6协议配置 */
@@ -109,9 +451,9 @@ void tcp_server_task(void *pvParameters)
         os_printf("Socket binded\r\n");
 
         /* 开始监听连接请求 
-         * 参数1表示最大待处理连接数
+         * 参数为最大待处理连接数
          */
-        err = listen(listen_sock, 1);
+        err = listen(listen_sock, MAX_CLIENTS);
         if (err != 0)
         {
             os_printf("Error occured during listen: errno %d\r\n", errno);
@@ -127,98 +469,110 @@ void tcp_server_task(void *pvParameters)
 #endif
         uint32_t addrLen = sizeof(sourceAddr);
         
-        /* 连接处理循环 */
+        fcntl(listen_sock, F_SETFL, fcntl(listen_sock, F_GETFL, 0) | O_NONBLOCK);
+
+        /* 事件循环: 同时等待新连接、拥有者连接的收发和等待中连接的数据 */
         while (1)
         {
-            /* 接受新的客户端连接 */
-            kSock = accept(listen_sock, (struct sockaddr *)&sourceAddr, &addrLen);
-            if (kSock < 0)
+            FD_ZERO(&rfds);
+            FD_ZERO(&wfds);
+            FD_SET(listen_sock, &rfds);
+            max_fd = listen_sock;
+
+            if (kSock != -1)
+            {
+                FD_SET(kSock, &rfds);
+                if (tcp_tx_pending(&tcp_tx))
+                {
+                    FD_SET(kSock, &wfds);
+                }
+                max_fd = MAX(max_fd, kSock);
+            }
+
+            for (int i = 0; i < MAX_CLIENTS - 1; i++)
+            {
+                if (tcp_sessions[i].sock != -1)
+                {
+                    FD_SET(tcp_sessions[i].sock, &rfds);
+                    max_fd = MAX(max_fd, tcp_sessions[i].sock);
+                }
+            }
+
+            tv.tv_sec = 0;
+            tv.tv_usec = TCP_SERVER_POLL_MS * 1000;
+
+            ret = select(max_fd + 1, &rfds, &wfds, NULL, &tv);
+            if (ret < 0)
             {
-                os_printf("Unable to accept connection: errno %d\r\n", errno);
+                os_printf("select failed: errno %d\r\n", errno);
                 break;
             }
 
-            /* 为新连接设置Socket选项 */
-            setsockopt(kSock, SOL_SOCKET, SO_KEEPALIVE, (void *)&on, sizeof(on));
-            setsockopt(kSock, IPPROTO_TCP, TCP_NODELAY, (void *)&on, sizeof(on));
-            os_printf("Socket accepted\r\n");
+            /* 拥有者连接 */
+            if (kSock != -1 && tcp_server_poll(FD_ISSET(kSock, &rfds)) < 0)
+            {
+                tcp_server_close();
+            }
 
-            /* 数据接收处理循环 */
-            while (1)
+            /* 等待中的连接 */
+            for (int i = 0; i < MAX_CLIENTS - 1; i++)
             {
-                /* 接收数据 */
-                int len = recv(kSock, tcp_rx_buffer, sizeof(tcp_rx_buffer), 0);
+                tcp_session_t *session = &tcp_sessions[i];
 
-                /* 接收错误处理 */
-                if (len < 0)
+                if (session->sock == -1)
                 {
-                    os_printf("recv failed: errno %d\r\n", errno);
-                    break;
+                    continue;
                 }
-                /* 连接关闭处理 */
-                else if (len == 0)
+
+                if (FD_ISSET(session->sock, &rfds))
                 {
-                    os_printf("Connection closed\r\n");
-                    break;
+                    tcp_session_recv(session);
                 }
-                /* 正常数据处理 */
-                else
+
+                if (session->sock != -1 &&
+                    (xTaskGetTickCount() - session->since) > pdMS_TO_TICKS(TCP_SESSION_WAIT_MS))
+                {
+                    tcp_session_reject(session);
+                }
+            }
+
+            /* 接受新的客户端连接 */
+            if (FD_ISSET(listen_sock, &rfds))
+            {
+                addrLen = sizeof(sourceAddr);
+                int sock = accept(listen_sock, (struct sockaddr *)&sourceAddr, &addrLen);
+                if (sock < 0)
                 {
-                    /* 根据当前状态处理接收到的数据 */
-                    switch (kState)
+                    if (errno != EAGAIN && errno != EWOULDBLOCK)
                     {
-                    case ACCEPTING:
-                        kState = ATTACHING;    // 更新状态为正在连接
-                        // fallthrough         // 继续执行ATTACHING的处理
-                    case ATTACHING:
-                        /* 尝试elaphureLink协议握手 */
-                        if (el_handshake_process(kSock, tcp_rx_buffer, len) == 0) {
-                            // 握手成功,切换到elaphureLink数据传输阶段
-                            kState = EL_DATA_PHASE;
-                            kRestartDAPHandle = DELETE_HANDLE;
-                            el_process_buffer_malloc();
-                            break;
-                        }
-
-                        /* 如果不是elaphureLink协议,则按USBIP协议处理 */
-                        attach(tcp_rx_buffer, len);
-                        break;
-
-                    case EMULATING:
-                        /* USBIP协议数据传输阶段 */
-                        emulate(tcp_rx_buffer, len);
-                        break;
-
-                    case EL_DATA_PHASE:
-                        /* elaphureLink协议数据传输阶段 */
-                        el_dap_data_process(tcp_rx_buffer, len);
-                        break;
-
-                    default:
-                        os_printf("unkonw kstate!\r\n");
+                        os_printf("Unable to accept connection: errno %d\r\n", errno);
                     }
                 }
+                else
+                {
+                    tcp_server_setup_socket(sock);
+                    os_printf("Socket accepted\r\n");
+                    tcp_session_add(sock);
+                }
             }
 
-            /* 连接清理工作 */
-            if (kSock != -1)
+            /* DAP空闲时交给等待最久的连接 */
+            if (kSock == -1)
             {
-                os_printf("Shutting down socket and restarting...\r\n");
-                close(kSock);    // 关闭Socket
-
-                /* 重置连接状态 */
-                if (kState == EMULATING || kState == EL_DATA_PHASE)
-                    kState = ACCEPTING;
-
-                /* 清理DAP相关资源 */
-                el_process_buffer_free();
+                tcp_session_promote();
+            }
+        }
 
-                /* 重启DAP任务 */
-                kRestartDAPHandle = RESET_HANDLE;
-                if (kDAPTaskHandle)
-                    xTaskNotifyGive(kDAPTaskHandle);
+        tcp_server_close();
+        for (int i = 0; i < MAX_CLIENTS - 1; i++)
+        {
+            if (tcp_sessions[i].sock != -1)
+            {
+                close(tcp_sessions[i].sock);
+                tcp_sessions[i].sock = -1;
             }
         }
+        close(listen_sock);
     }
     vTaskDelete(NULL);    // 删除当前任务
 }
\ No newline at end of file
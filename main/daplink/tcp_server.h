@@ -1,7 +1,12 @@
 #ifndef __TCP_SERVER_H__
 #define __TCP_SERVER_H__
 
+#include <stddef.h>
+#include <stdint.h>
 
 void tcp_server_task(void *pvParameters);
+void tcp_server_dispatch(uint8_t *buffer, uint32_t len);
+int tcp_server_send(int s, const void *data, size_t size, int flags);
+int tcp_server_send_ctrl(int s, const void *data, size_t size);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,225 @@
+/**
+ * @file tcp_stream.c
+ * @brief 从TCP字节流中切分出完整的USBIP/elaphureLink消息
+ *
+ * 消息长度按当前连接状态解析:
+ *   - 连接阶段: elaphureLink握手, 或USBIP stage1请求
+ *   - USBIP阶段: stage2头部, OUT方向的SUBMIT带 transfer_buffer_length 字节数据
+ *   - elaphureLink阶段: 按DAP命令格式解析请求长度
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "tcp_stream.h"
+#include "usbip_server.h"
+
+#include "components/elaphureLink/elaphureLink_protocol.h"
+
+#include "lwip/sockets.h"
+
+#define USBIP_ISO_DESCRIPTOR_SIZE 16
+
+void tcp_stream_reset(tcp_stream_t *stream)
+{
+    stream->start = 0;
+    stream->end = 0;
+}
+
+// 把未处理完的半条消息移到开头, 之前交出的消息此后失效
+static void tcp_stream_compact(tcp_stream_t *stream)
+{
+    if (stream->start > 0)
+    {
+        memmove(stream->buf, &stream->buf[stream->start], stream->end - stream->start);
+        stream->end -= stream->start;
+        stream->start = 0;
+    }
+}
+
+/**
+ * @brief 缓冲区空闲字节数
+ */
+uint32_t tcp_stream_space(tcp_stream_t *stream)
+{
+    tcp_stream_compact(stream);
+    return TCP_STREAM_BUFFER_SIZE - stream->end;
+}
+
+/**
+ * @brief 放入已在别处接收的数据
+ *
+ * @return 放入的字节数, 缓冲区不足时小于len
+ */
+uint32_t tcp_stream_push(tcp_stream_t *stream, const uint8_t *data, uint32_t len)
+{
+    tcp_stream_compact(stream);
+
+    if (len > TCP_STREAM_BUFFER_SIZE - stream->end)
+    {
+        len = TCP_STREAM_BUFFER_SIZE - stream->end;
+    }
+
+    memcpy(&stream->buf[stream->end], data, len);
+    stream->end += len;
+
+    return len;
+}
+
+/**
+ * @brief 接收数据到缓冲区空闲部分
+ *
+ * @return 与recv()相同: 接收字节数, 0表示连接关闭, 负数表示出错
+ */
+int tcp_stream_recv(tcp_stream_t *stream, int sock)
+{
+    int len;
+
+    tcp_stream_compact(stream);
+
+    len = recv(sock, &stream->buf[stream->end], TCP_STREAM_BUFFER_SIZE - stream->end, 0);
+    if (len > 0)
+    {
+        stream->end += len;
+    }
+
+    return len;
+}
+
+// USBIP stage1请求或elaphureLink握手的长度, 0表示数据还不够判断
+static uint32_t tcp_stream_attach_length(const uint8_t *buf, uint32_t avail)
+{
+    const usbip_stage1_header *header = (const usbip_stage1_header *)buf;
+    uint32_t identifier;
+
+    if (avail < sizeof(uint32_t))
+    {
+        return 0;
+    }
+
+    memcpy(&identifier, buf, sizeof(identifier));
+    if (ntohl(identifier) == EL_LINK_IDENTIFIER)
+    {
+        return sizeof(el_request_handshake);
+    }
+
+    if (avail < sizeof(usbip_stage1_header))
+    {
+        return 0;
+    }
+
+    // OP_REQ_IMPORT 后跟总线ID, 其余请求只有头部
+    if ((ntohs(header->command) & 0xFF) == USBIP_STAGE1_CMD_DEVICE_ATTACH)
+    {
+        return sizeof(usbip_stage1_header) + USBIP_BUSID_SIZE;
+    }
+
+    return sizeof(usbip_stage1_header);
+}
+
+// USBIP stage2消息的长度, 0表示头部还不完整
+static uint32_t tcp_stream_urb_length(const uint8_t *buf, uint32_t avail)
+{
+    const usbip_stage2_header *header = (const usbip_stage2_header *)buf;
+    uint32_t length = sizeof(usbip_stage2_header);
+    uint32_t packets;
+
+    if (avail < sizeof(usbip_stage2_header))
+    {
+        return 0;
+    }
+
+    if (ntohl(header->base.command) != USBIP_STAGE2_REQ_SUBMIT)
+    {
+        return length;
+    }
+
+    if (ntohl(header->base.direction) == USBIP_DIR_OUT)
+    {
+        length += (uint32_t)ntohl(header->u.cmd_submit.data_length);
+    }
+
+    // 非等时传输为0, usbip-win 填 0xFFFFFFFF
+    packets = ntohl(header->u.cmd_submit.number_of_packets);
+    if (packets != 0 && packets != 0xFFFFFFFF)
+    {
+        length += packets * USBIP_ISO_DESCRIPTOR_SIZE;
+    }
+
+    return length;
+}
+
+/**
+ * @brief 按连接状态计算buf开头消息的长度
+ *
+ * @return 消息长度, 0表示数据还不够判断
+ */
+uint32_t tcp_stream_message_length(uint8_t state, const uint8_t *buf, uint32_t avail)
+{
+    if (avail == 0)
+    {
+        return 0;
+    }
+
+    switch (state)
+    {
+    case EMULATING:
+        return tcp_stream_urb_length(buf, avail);
+
+    case EL_DATA_PHASE:
+        return el_dap_batch_length(buf, avail);
+
+    default:
+        return tcp_stream_attach_length(buf, avail);
+    }
+}
+
+/**
+ * @brief 取出下一条完整消息
+ *
+ * 消息留在缓冲区中原地处理, 直到下一次 tcp_stream_recv() 之前有效。
+ * 交出的消息起点总是4字节对齐。
+ *
+ * @param state 当前连接状态, 决定消息格式
+ * @return 1 取出一条消息, 0 需要更多数据, -1 消息超出缓冲区(流已失步)
+ */
+int tcp_stream_next(tcp_stream_t *stream, uint8_t state, uint8_t **msg, uint32_t *len)
+{
+    uint8_t *buf = &stream->buf[stream->start];
+    uint32_t avail = stream->end - stream->start;
+    uint32_t length;
+
+    if (avail == 0)
+    {
+        return 0;
+    }
+
+    length = tcp_stream_message_length(state, buf, avail);
+
+    // 消息放不进缓冲区, 或缓冲区满了仍无法判断长度
+    if (length > TCP_STREAM_BUFFER_SIZE || (length == 0 && avail == TCP_STREAM_BUFFER_SIZE))
+    {
+        return -1;
+    }
+
+    if (length == 0 || length > avail)
+    {
+        return 0;
+    }
+
+    // 前一条消息长度不是4的倍数时, 把本条消息前移到对齐位置, 让其头部可以按字访问;
+    // 前移覆盖的字节属于已处理完的消息
+    if (((uintptr_t)buf & 3) != 0)
+    {
+        uint8_t *aligned = (uint8_t *)((uintptr_t)buf & ~(uintptr_t)3);
+
+        memmove(aligned, buf, length);
+        buf = aligned;
+    }
+
+    *msg = buf;
+    *len = length;
+    stream->start += length;
+
+    return 1;
+}
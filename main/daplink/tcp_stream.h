@@ -0,0 +1,41 @@
+#ifndef __TCP_STREAM_H__
+#define __TCP_STREAM_H__
+
+#include <stdint.h>
+
+/**
+ * @brief 接收缓冲区大小
+ *
+ * 需容纳一个完整的最大消息(USBIP头 + DAP包)以及紧随其后的一个TCP段
+ */
+#define TCP_STREAM_BUFFER_SIZE 4096
+
+/**
+ * @brief 缓冲区末尾余量
+ *
+ * DAP请求按固定包大小入队, 可能读到消息之后的字节, 余量保证不越界
+ */
+#define TCP_STREAM_TAIL_ROOM 1024
+
+/**
+ * @brief TCP字节流重组缓冲区
+ *
+ * TCP不保留消息边界, 一次recv()可能包含多条消息或半条消息。
+ * 已接收未处理的数据位于 [start, end), 完整消息原地交给处理函数,
+ * 剩余的半条消息在下次接收前移到缓冲区开头。
+ */
+typedef struct
+{
+    uint8_t buf[TCP_STREAM_BUFFER_SIZE + TCP_STREAM_TAIL_ROOM] __attribute__((aligned(4)));
+    uint32_t start; // 第一个未处理的字节
+    uint32_t end;   // 已接收数据的末尾
+} tcp_stream_t;
+
+void tcp_stream_reset(tcp_stream_t *stream);
+uint32_t tcp_stream_space(tcp_stream_t *stream);
+uint32_t tcp_stream_push(tcp_stream_t *stream, const uint8_t *data, uint32_t len);
+int tcp_stream_recv(tcp_stream_t *stream, int sock);
+uint32_t tcp_stream_message_length(uint8_t state, const uint8_t *buf, uint32_t avail);
+int tcp_stream_next(tcp_stream_t *stream, uint8_t state, uint8_t **msg, uint32_t *len);
+
+#endif
@@ -0,0 +1,349 @@
+/**
+ * @file tcp_tx.c
+ * @brief TCP连接的非阻塞发送队列
+ *
+ * 发送顺序:
+ *   1. 已发出一部分的普通消息, 必须先发完
+ *   2. 控制消息
+ *   3. 其余普通数据, 一次send()合并发出
+ * 出错后队列丢弃所有数据, 由连接处理循环关闭socket。
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <sys/select.h>
+
+#include "tcp_tx.h"
+
+#include "lwip/sockets.h"
+
+void tcp_tx_init(tcp_tx_t *tx)
+{
+    memset(tx, 0, sizeof(*tx));
+    tx->sock = -1;
+    tx->mux = xSemaphoreCreateMutexStatic(&tx->mux_buffer);
+}
+
+static void tcp_tx_clear(tcp_tx_t *tx)
+{
+    tx->start = tx->end = 0;
+    tx->msg_head = tx->msg_count = 0;
+    tx->head_sent = 0;
+    tx->msg_open = 0;
+    tx->ctrl_start = tx->ctrl_end = 0;
+}
+
+/**
+ * @brief 切换到新的连接, sock为-1表示连接已关闭
+ */
+void tcp_tx_reset(tcp_tx_t *tx, int sock)
+{
+    xSemaphoreTake(tx->mux, portMAX_DELAY);
+    tcp_tx_clear(tx);
+    tx->sock = sock;
+    tx->error = 0;
+    tx->cork = 0;
+    xSemaphoreGive(tx->mux);
+}
+
+// 非阻塞发送, 返回已发送字节数; socket缓冲区满时为0
+static int tcp_tx_send(tcp_tx_t *tx, const uint8_t *data, uint32_t len)
+{
+    int ret = send(tx->sock, data, len, MSG_DONTWAIT);
+
+    if (ret < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return 0;
+        }
+        tx->error = 1;
+        tcp_tx_clear(tx);
+        return -1;
+    }
+
+    return ret;
+}
+
+// 普通数据已发出n字节, 更新消息边界
+static void tcp_tx_consume(tcp_tx_t *tx, uint32_t n)
+{
+    uint32_t left;
+
+    tx->start += n;
+
+    while (n > 0)
+    {
+        left = tx->msg_len[tx->msg_head] - tx->head_sent;
+        if (n < left)
+        {
+            tx->head_sent += n;
+            break;
+        }
+
+        n -= left;
+        tx->head_sent += left;
+
+        // 最后一条消息还在追加, 保持未完成状态
+        if (tx->msg_count == 1 && tx->msg_open)
+        {
+            break;
+        }
+
+        tx->msg_head = (tx->msg_head + 1) % TCP_TX_MSG_NUM;
+        tx->msg_count--;
+        tx->head_sent = 0;
+    }
+
+    if (tx->start == tx->end)
+    {
+        tx->start = tx->end = 0;
+    }
+}
+
+static int tcp_tx_flush_locked(tcp_tx_t *tx)
+{
+    uint32_t left;
+    int ret;
+
+    if (tx->error || tx->sock < 0)
+    {
+        return -1;
+    }
+
+    // 已开始发送的消息不能被打断
+    if (tx->head_sent > 0)
+    {
+        left = tx->msg_len[tx->msg_head] - tx->head_sent;
+        if (left > 0)
+        {
+            ret = tcp_tx_send(tx, &tx->buf[tx->start], left);
+            if (ret < 0)
+            {
+                return -1;
+            }
+            tcp_tx_consume(tx, ret);
+        }
+
+        if (tx->head_sent > 0)
+        {
+            return 0;
+        }
+    }
+
+    if (tx->ctrl_end > tx->ctrl_start)
+    {
+        ret = tcp_tx_send(tx, &tx->ctrl[tx->ctrl_start], tx->ctrl_end - tx->ctrl_start);
+        if (ret < 0)
+        {
+            return -1;
+        }
+
+        tx->ctrl_start += ret;
+        if (tx->ctrl_start < tx->ctrl_end)
+        {
+            return 0;
+        }
+        tx->ctrl_start = tx->ctrl_end = 0;
+    }
+
+    if (tx->end > tx->start)
+    {
+        ret = tcp_tx_send(tx, &tx->buf[tx->start], tx->end - tx->start);
+        if (ret < 0)
+        {
+            return -1;
+        }
+        tcp_tx_consume(tx, ret);
+    }
+
+    return 0;
+}
+
+// 等待socket可写, 超时视为连接异常
+static int tcp_tx_wait(tcp_tx_t *tx)
+{
+    struct timeval tv;
+    fd_set wfds;
+
+    FD_ZERO(&wfds);
+    FD_SET(tx->sock, &wfds);
+    tv.tv_sec = TCP_TX_WAIT_MS / 1000;
+    tv.tv_usec = (TCP_TX_WAIT_MS % 1000) * 1000;
+
+    if (select(tx->sock + 1, NULL, &wfds, NULL, &tv) <= 0)
+    {
+        tx->error = 1;
+        tcp_tx_clear(tx);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int tcp_tx_has_room(tcp_tx_t *tx, size_t size)
+{
+    // 把未发送的数据移到开头
+    if (tx->start > 0)
+    {
+        memmove(tx->buf, &tx->buf[tx->start], tx->end - tx->start);
+        tx->end -= tx->start;
+        tx->start = 0;
+    }
+
+    return (TCP_TX_BUFFER_SIZE - tx->end >= size) &&
+           (tx->msg_open || tx->msg_count < TCP_TX_MSG_NUM);
+}
+
+/**
+ * @brief 普通数据入队
+ *
+ * @param flags MSG_MORE 表示消息还有后续部分, 控制消息不会插在中间
+ * @return 入队字节数, 负数表示连接已不可用
+ */
+int tcp_tx_queue(tcp_tx_t *tx, const void *data, size_t size, int flags)
+{
+    uint32_t last;
+    int ret = -1;
+
+    if (size > TCP_TX_BUFFER_SIZE)
+    {
+        return -1;
+    }
+
+    xSemaphoreTake(tx->mux, portMAX_DELAY);
+
+    // 队列满时先发送, 仍然不够则等待对端确认
+    while (!tx->error && tx->sock >= 0 && !tcp_tx_has_room(tx, size))
+    {
+        if (tcp_tx_flush_locked(tx) < 0)
+        {
+            break;
+        }
+        if (!tcp_tx_has_room(tx, size) && tcp_tx_wait(tx) < 0)
+        {
+            break;
+        }
+    }
+
+    if (!tx->error && tx->sock >= 0)
+    {
+        memcpy(&tx->buf[tx->end], data, size);
+        tx->end += size;
+
+        if (tx->msg_open)
+        {
+            last = (tx->msg_head + tx->msg_count - 1) % TCP_TX_MSG_NUM;
+            tx->msg_len[last] += size;
+        }
+        else
+        {
+            last = (tx->msg_head + tx->msg_count) % TCP_TX_MSG_NUM;
+            tx->msg_len[last] = size;
+            tx->msg_count++;
+        }
+        tx->msg_open = (flags & MSG_MORE) ? 1 : 0;
+
+        ret = size;
+        if (!tx->cork && !tx->msg_open && tcp_tx_flush_locked(tx) < 0)
+        {
+            ret = -1;
+        }
+    }
+
+    xSemaphoreGive(tx->mux);
+    return ret;
+}
+
+/**
+ * @brief 控制消息入队并立即尝试发送, 不受cork影响
+ */
+int tcp_tx_queue_ctrl(tcp_tx_t *tx, const void *data, size_t size)
+{
+    int ret = -1;
+
+    if (size > TCP_TX_CTRL_SIZE)
+    {
+        return -1;
+    }
+
+    xSemaphoreTake(tx->mux, portMAX_DELAY);
+
+    if (tx->ctrl_start > 0)
+    {
+        memmove(tx->ctrl, &tx->ctrl[tx->ctrl_start], tx->ctrl_end - tx->ctrl_start);
+        tx->ctrl_end -= tx->ctrl_start;
+        tx->ctrl_start = 0;
+    }
+
+    // 控制队列满时等待, 控制消息很少, 一般不会发生
+    while (!tx->error && tx->sock >= 0 && TCP_TX_CTRL_SIZE - tx->ctrl_end < size)
+    {
+        if (tcp_tx_flush_locked(tx) < 0 || tcp_tx_wait(tx) < 0)
+        {
+            break;
+        }
+        memmove(tx->ctrl, &tx->ctrl[tx->ctrl_start], tx->ctrl_end - tx->ctrl_start);
+        tx->ctrl_end -= tx->ctrl_start;
+        tx->ctrl_start = 0;
+    }
+
+    if (!tx->error && tx->sock >= 0)
+    {
+        memcpy(&tx->ctrl[tx->ctrl_end], data, size);
+        tx->ctrl_end += size;
+        ret = (tcp_tx_flush_locked(tx) < 0) ? -1 : (int)size;
+    }
+
+    xSemaphoreGive(tx->mux);
+    return ret;
+}
+
+/**
+ * @brief 尽量发送积压数据, 不阻塞
+ *
+ * @return 0: 正常(可能还有数据未发出); 负数: 连接出错
+ */
+int tcp_tx_flush(tcp_tx_t *tx)
+{
+    int ret;
+
+    xSemaphoreTake(tx->mux, portMAX_DELAY);
+    ret = tcp_tx_flush_locked(tx);
+    xSemaphoreGive(tx->mux);
+
+    return ret;
+}
+
+int tcp_tx_pending(tcp_tx_t *tx)
+{
+    int pending;
+
+    xSemaphoreTake(tx->mux, portMAX_DELAY);
+    pending = (tx->end > tx->start) || (tx->ctrl_end > tx->ctrl_start);
+    xSemaphoreGive(tx->mux);
+
+    return pending;
+}
+
+/**
+ * @brief 暂缓/恢复发送
+ *
+ * 处理一批接收到的消息期间暂缓发送, 处理完后把产生的回复合并发出
+ *
+ * @return 恢复发送时同 tcp_tx_flush()
+ */
+int tcp_tx_cork(tcp_tx_t *tx, int cork)
+{
+    int ret = 0;
+
+    xSemaphoreTake(tx->mux, portMAX_DELAY);
+    tx->cork = cork ? 1 : 0;
+    if (!cork)
+    {
+        ret = tcp_tx_flush_locked(tx);
+    }
+    xSemaphoreGive(tx->mux);
+
+    return ret;
+}
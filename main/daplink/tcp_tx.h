@@ -0,0 +1,71 @@
+#ifndef __TCP_TX_H__
+#define __TCP_TX_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/**
+ * @brief 普通数据发送队列大小
+ *
+ * 需容纳至少一条最大消息(USBIP头 + DAP包), 其余空间用于积压和合并
+ */
+#define TCP_TX_BUFFER_SIZE 8192
+
+/**
+ * @brief 控制消息队列大小 (unlink回复等)
+ */
+#define TCP_TX_CTRL_SIZE 256
+
+/**
+ * @brief 普通队列中最多记录的消息条数
+ */
+#define TCP_TX_MSG_NUM 64
+
+/**
+ * @brief 队列满时等待socket可写的最长时间
+ */
+#define TCP_TX_WAIT_MS 1000
+
+/**
+ * @brief 单个连接的非阻塞发送队列
+ *
+ * 消息先入队, socket可写时尽量一次send()发出所有积压数据。
+ * 控制消息走独立队列, 在普通数据的消息边界处插队发送,
+ * 不会被排在后面的大块数据阻塞。
+ * 普通数据位于 [start, end), 各消息长度按顺序记录在 msg_len 中。
+ */
+typedef struct
+{
+    int sock;
+    uint8_t error;                      // 发送出错, 连接应关闭
+    uint8_t cork;                       // 非0时暂缓发送, 以便合并多条消息
+
+    uint8_t buf[TCP_TX_BUFFER_SIZE];
+    uint32_t start;                     // 第一个未发送的字节
+    uint32_t end;                       // 已入队数据的末尾
+    uint16_t msg_len[TCP_TX_MSG_NUM];
+    uint32_t msg_head;
+    uint32_t msg_count;
+    uint32_t head_sent;                 // 队首消息已发送的字节数
+    uint8_t msg_open;                   // 最后一条消息还有后续部分 (MSG_MORE)
+
+    uint8_t ctrl[TCP_TX_CTRL_SIZE];
+    uint32_t ctrl_start;
+    uint32_t ctrl_end;
+
+    SemaphoreHandle_t mux;
+    StaticSemaphore_t mux_buffer;
+} tcp_tx_t;
+
+void tcp_tx_init(tcp_tx_t *tx);
+void tcp_tx_reset(tcp_tx_t *tx, int sock);
+int tcp_tx_queue(tcp_tx_t *tx, const void *data, size_t size, int flags);
+int tcp_tx_queue_ctrl(tcp_tx_t *tx, const void *data, size_t size);
+int tcp_tx_flush(tcp_tx_t *tx);
+int tcp_tx_pending(tcp_tx_t *tx);
+int tcp_tx_cork(tcp_tx_t *tx, int cork);
+
+#endif
@@ -4,15 +4,23 @@
 
 // 包含项目头文件
 #include "usbip_server.h"
-// #include "main/kcp_server.h"
-// #include "main/tcp_netconn.h"
 #include "DAP_handle.h"
+#include "tcp_server.h"
 #include "wifi/wifi_configuration.h"
+#if (USE_KCP == 1)
+#include "kcp_server.h"
+#elif (USE_TCP_NETCONN == 1)
+#include "tcp_netconn.h"
+#endif
 
 // 包含USBIP组件头文件
 #include "components/USBIP/usb_handle.h"
 #include "components/USBIP/usb_descriptor.h"
 
+// 包含FreeRTOS头文件
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
 // 包含lwip网络协议栈头文件
 #include "lwip/err.h"
 #include "lwip/sockets.h"
@@ -37,16 +45,53 @@ static int read_stage2_command(usbip_stage2_header *header, uint32_t length);
 
 static void handle_unlink(usbip_stage2_header *header);
 // unlink相关的辅助函数声明
-static void send_stage2_unlink(usbip_stage2_header *req_header);
+static void send_stage2_unlink(usbip_stage2_header *req_header, int32_t status);
+
+// DAP线程也会直接回复URB, 一条消息的各段发送期间必须持有此锁
+static SemaphoreHandle_t usbip_send_mux = NULL;
+static StaticSemaphore_t usbip_send_mux_buffer;
+
+void usbip_server_init()
+{
+    if (usbip_send_mux == NULL)
+    {
+        usbip_send_mux = xSemaphoreCreateRecursiveMutexStatic(&usbip_send_mux_buffer);
+    }
+}
+
+static void usbip_send_lock()
+{
+    xSemaphoreTakeRecursive(usbip_send_mux, portMAX_DELAY);
+}
+
+static void usbip_send_unlock()
+{
+    xSemaphoreGiveRecursive(usbip_send_mux);
+}
 
 // 根据不同的网络传输方式发送数据
 int usbip_network_send(int s, const void *dataptr, size_t size, int flags) {
+    int ret = -1;
+
+    usbip_send_lock();
 #if (USE_KCP == 1)
-    // return kcp_network_send(dataptr, size);
+    ret = kcp_server_send(dataptr, size, flags);
 #elif (USE_TCP_NETCONN == 1)
-    // return tcp_netconn_send(dataptr, size);
-#else // BSD socket方式
-    return send(s, dataptr, size, flags);
+    ret = tcp_netconn_send(dataptr, size, flags);
+#else // BSD socket方式, 经发送队列非阻塞发出
+    ret = tcp_server_send(s, dataptr, size, flags);
+#endif
+    usbip_send_unlock();
+
+    return ret;
+}
+
+// 发送控制消息, 不排在普通数据之后
+static int usbip_network_send_ctrl(int s, const void *dataptr, size_t size) {
+#if (USE_KCP == 1) || (USE_TCP_NETCONN == 1)
+    return usbip_network_send(s, dataptr, size, 0);
+#else
+    return tcp_server_send_ctrl(s, dataptr, size);
 #endif
 }
 
@@ -120,7 +165,7 @@ static void send_stage1_header(uint16_t command, uint32_t status)
 {
     os_printf("Sending header...\r\n");
     usbip_stage1_header header;
-    header.version = htons(273); // USBIP协议版本号
+    header.version = htons(USBIP_VERSION); // USBIP协议版本号
     // 参考: https://github.com/Oxalin/usbip_windows/issues/4
 
     header.command = htons(command);
@@ -245,7 +290,7 @@ static int read_stage2_command(usbip_stage2_header *header, uint32_t length)
     }
 
     //client.readBytes((uint8_t *)&header, sizeof(usbip_stage2_header));
-    unpack((uint32_t *)header, sizeof(usbip_stage2_header));
+    unpack(header, sizeof(usbip_stage2_header));
     return header->base.command;
 }
 
@@ -264,12 +309,15 @@ static void pack(void *data, int size)
 
     // 忽略setup字段
     int sz = (size / sizeof(uint32_t)) - 2;
-    uint32_t *ptr = (uint32_t *)data;
+    uint8_t *ptr = (uint8_t *)data;
+    uint32_t word;
 
-    for (int i = 0; i < sz; i++)
+    // 数据包头可能位于非对齐地址, 逐字拷贝后再转换, 不能按uint32_t*直接访问
+    for (int i = 0; i < sz; i++, ptr += sizeof(uint32_t))
     {
-
-        ptr[i] = htonl(ptr[i]);
+        memcpy(&word, ptr, sizeof(word));
+        word = htonl(word);
+        memcpy(ptr, &word, sizeof(word));
     }
 }
 
@@ -288,11 +336,14 @@ static void unpack(void *data, int size)
 
     // 忽略setup字段
     int sz = (size / sizeof(uint32_t)) - 2;
-    uint32_t *ptr = (uint32_t *)data;
+    uint8_t *ptr = (uint8_t *)data;
+    uint32_t word;
 
-    for (int i = 0; i < sz; i++)
+    for (int i = 0; i < sz; i++, ptr += sizeof(uint32_t))
     {
-        ptr[i] = ntohl(ptr[i]);
+        memcpy(&word, ptr, sizeof(word));
+        word = ntohl(word);
+        memcpy(ptr, &word, sizeof(word));
     }
 }
 
@@ -355,8 +406,8 @@ static int handle_submit(usbip_stage2_header *header, uint32_t length)
     return 0;
 }
 
-// 发送stage2 submit响应
-void send_stage2_submit(usbip_stage2_header *req_header, int32_t status, int32_t data_length)
+// 发送stage2 submit响应头, 后面还有数据时 flags 为 MSG_MORE
+static void send_stage2_submit_header(usbip_stage2_header *req_header, int32_t status, int32_t data_length, int flags)
 {
 
     req_header->base.command = USBIP_STAGE2_RSP_SUBMIT;
@@ -368,36 +419,40 @@ void send_stage2_submit(usbip_stage2_header *req_header, int32_t status, int32_t
     req_header->u.ret_submit.data_length = data_length;
     // 已经解包过的数据需要重新打包
     pack(req_header, sizeof(usbip_stage2_header));
-    usbip_network_send(kSock, req_header, sizeof(usbip_stage2_header), 0);
+    usbip_network_send(kSock, req_header, sizeof(usbip_stage2_header), flags);
+}
+
+// 发送stage2 submit响应
+void send_stage2_submit(usbip_stage2_header *req_header, int32_t status, int32_t data_length)
+{
+    send_stage2_submit_header(req_header, status, data_length, 0);
 }
 
 // 发送stage2 submit响应和数据
 void send_stage2_submit_data(usbip_stage2_header *req_header, int32_t status, const void *const data, int32_t data_length)
 {
 
-    send_stage2_submit(req_header, status, data_length);
+    usbip_send_lock();
+    send_stage2_submit_header(req_header, status, data_length, data_length ? MSG_MORE : 0);
 
     if (data_length)
     {
         usbip_network_send(kSock, data, data_length, 0);
     }
+    usbip_send_unlock();
 }
 
 // 快速发送stage2 submit响应和数据
-void send_stage2_submit_data_fast(usbip_stage2_header *req_header, const void *const data, int32_t data_length)
+// 数据负载必须紧跟在 req_header 之后, 头部原地改写后与负载一次发出
+void send_stage2_submit_data_fast(usbip_stage2_header *req_header, int32_t data_length)
 {
-    uint8_t * send_buf = (uint8_t *)req_header;
-
     req_header->base.command = PP_HTONL(USBIP_STAGE2_RSP_SUBMIT);
     req_header->base.direction = htonl(!(req_header->base.direction));
 
     memset(&(req_header->u.ret_submit), 0, sizeof(usbip_stage2_header_ret_submit));
     req_header->u.ret_submit.data_length = htonl(data_length);
 
-
-    // 复制数据负载
-    memcpy(&send_buf[sizeof(usbip_stage2_header)], data, data_length);
-    usbip_network_send(kSock, send_buf, sizeof(usbip_stage2_header) + data_length, 0);
+    usbip_network_send(kSock, req_header, sizeof(usbip_stage2_header) + data_length, 0);
 }
 
 
@@ -405,12 +460,11 @@ void send_stage2_submit_data_fast(usbip_stage2_header *req_header, const void *c
 static void handle_unlink(usbip_stage2_header *header)
 {
     os_printf("s2 handling cmd unlink...\r\n");
-    handle_dap_unlink();
-    send_stage2_unlink(header);
+    send_stage2_unlink(header, handle_dap_unlink(header->u.cmd_unlink.seqnum));
 }
 
 // 发送stage2 unlink响应
-static void send_stage2_unlink(usbip_stage2_header *req_header)
+static void send_stage2_unlink(usbip_stage2_header *req_header, int32_t status)
 {
 
     req_header->base.command = USBIP_STAGE2_RSP_UNLINK;
@@ -418,12 +472,19 @@ static void send_stage2_unlink(usbip_stage2_header *req_header)
 
     memset(&(req_header->u.ret_unlink), 0, sizeof(usbip_stage2_header_ret_unlink));
 
-    // 更准确的说应该是 `-ECONNRESET`, 但usbip-win只关心是否为非零值
-    // 非零值表示UNLINK操作"成功",但主机驱动可能有不同的行为,甚至可能忽略这个状态
-    // 为了保持一致性,这里使用非零值。另见handle_dap_unlink()的相关注释
-    req_header->u.ret_unlink.status = -1;
+    // -ECONNRESET 表示URB已被取消, 0 表示URB在取消前已经完成
+    req_header->u.ret_unlink.status = status;
 
     pack(req_header, sizeof(usbip_stage2_header));
 
-    usbip_network_send(kSock, req_header, sizeof(usbip_stage2_header), 0);
+    // 已取消的URB没有排队中的回复, 可以插队;
+    // 已完成的URB其回复可能还在队列中, 必须排在它后面
+    if (status != 0)
+    {
+        usbip_network_send_ctrl(kSock, req_header, sizeof(usbip_stage2_header));
+    }
+    else
+    {
+        usbip_network_send(kSock, req_header, sizeof(usbip_stage2_header), 0);
+    }
 }
\ No newline at end of file
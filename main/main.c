@@ -25,13 +25,77 @@
 #include "nvs_flash.h"
 #include "wifi/wifi_handle.h"
 #include "tusb_config.h"
+#include "programmer/programmer.h"
+#include "wifi/wifi_configuration.h"
 
 extern void DAP_Setup(void);
 extern void tcp_server_task(void *pvParameters);
+extern void kcp_server_task(void *pvParameters);
+extern void tcp_netconn_task(void *pvParameters);
 extern void DAP_Thread(void *pvParameters);
+extern void dap_swd_owner_init(void);
 
 TaskHandle_t kDAPTaskHandle = NULL;
 
+#if (CONFIG_NET_TASK_CORE < 0)
+#define NET_TASK_CORE tskNO_AFFINITY
+#else
+#define NET_TASK_CORE CONFIG_NET_TASK_CORE
+#endif
+
+#if CONFIG_TASK_LOAD_REPORT
+#define TASK_LOAD_MAX_TASKS 32
+
+/**
+ * @brief 周期打印各任务的CPU占用率
+ * @note 占用率为上一周期内占用单个核的比例, 每个核的IDLE任务即该核的空闲余量
+ */
+static void task_load_task(void *pvParameters)
+{
+    static TaskStatus_t status[TASK_LOAD_MAX_TASKS];
+    static TaskHandle_t last_handle[TASK_LOAD_MAX_TASKS];
+    static configRUN_TIME_COUNTER_TYPE last_runtime[TASK_LOAD_MAX_TASKS];
+    UBaseType_t last_count = 0;
+    configRUN_TIME_COUNTER_TYPE total, last_total = 0, runtime;
+    UBaseType_t count;
+    BaseType_t core;
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_TASK_LOAD_REPORT_PERIOD * 1000));
+
+        count = uxTaskGetSystemState(status, TASK_LOAD_MAX_TASKS, &total);
+        if (count == 0 || total == last_total) {
+            continue;
+        }
+
+        printf("Task load:\n");
+        for (UBaseType_t i = 0; i < count; i++) {
+            runtime = status[i].ulRunTimeCounter;
+            for (UBaseType_t j = 0; j < last_count; j++) {
+                if (last_handle[j] == status[i].xHandle) {
+                    runtime -= last_runtime[j];
+                    break;
+                }
+            }
+
+            core = xTaskGetCoreID(status[i].xHandle);
+            printf("  %-16s core %c prio %2u %3u%%\n",
+                   status[i].pcTaskName,
+                   (core == tskNO_AFFINITY) ? '-' : (char)('0' + core),
+                   (unsigned)status[i].uxCurrentPriority,
+                   (unsigned)((uint64_t)runtime * 100 / (total - last_total)));
+        }
+
+        for (UBaseType_t i = 0; i < count; i++) {
+            last_handle[i] = status[i].xHandle;
+            last_runtime[i] = status[i].ulRunTimeCounter;
+        }
+        last_count = count;
+        last_total = total;
+    }
+}
+#endif
+
 /**
  * @brief 主程序入口函数
  * @note 程序启动
@@ -75,6 +139,27 @@ void app_main(void)
     ESP_ERROR_CHECK(nvs_flash_init());
     wifi_init();    
     DAP_Setup();
-    xTaskCreate(tcp_server_task, "tcp_server", 4096, NULL, 14, NULL);
-    xTaskCreate(DAP_Thread, "DAP_Task", 2048, NULL, 10, &kDAPTaskHandle);
+    dap_swd_owner_init();
+    if (programmer_init() != ESP_OK) {
+        printf("Offline programmer init failed\n");
+    }
+
+    /* 网络任务与WiFi/lwIP在同一个核上, DAP线程独占另一个核
+     * 各驱动的中断在app_main所在的PRO_CPU上注册, 不会打断SWD时序 */
+#if (USE_KCP == 1)
+    xTaskCreatePinnedToCore(kcp_server_task, "kcp_server", 4096, NULL,
+                            CONFIG_NET_TASK_PRIORITY, NULL, NET_TASK_CORE);
+#elif (USE_TCP_NETCONN == 1)
+    xTaskCreatePinnedToCore(tcp_netconn_task, "tcp_netconn", 4096, NULL,
+                            CONFIG_NET_TASK_PRIORITY, NULL, NET_TASK_CORE);
+#else
+    xTaskCreatePinnedToCore(tcp_server_task, "tcp_server", 4096, NULL,
+                            CONFIG_NET_TASK_PRIORITY, NULL, NET_TASK_CORE);
+#endif
+    xTaskCreatePinnedToCore(DAP_Thread, "DAP_Task", 4096, NULL,
+                            CONFIG_DAP_TASK_PRIORITY, &kDAPTaskHandle, CONFIG_DAP_TASK_CORE); // 需直接在套接字上回复URB
+
+#if CONFIG_TASK_LOAD_REPORT
+    xTaskCreatePinnedToCore(task_load_task, "task_load", 3072, NULL, 1, NULL, 0);
+#endif
 }
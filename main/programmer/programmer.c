@@ -0,0 +1,634 @@
+/*
+ * @Description: 脱机烧录引擎,挂载storage分区,加载算法和固件后在探针上完成
+ *               初始化/擦除/编程/校验/反初始化全过程
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include "programmer.h"
+#include "usbip_server.h"
+#include "DAP_handle.h"
+
+#include "components/DAP/Include/flash_algo.h"
+#include "components/DAP/Include/target_flash.h"
+#include "components/DAP/Include/swd_host.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "esp_vfs_fat.h"
+#include "wear_levelling.h"
+
+static const char *TAG = "programmer";
+
+#define PROGRAMMER_ALIGN_UP(x, a) (((x) + ((a) - 1)) / (a) * (a))
+// 等待DAP线程处理完当前命令、交出SWD的最长时间
+#define PROGRAMMER_SWD_WAIT_MS 1000
+
+// 固件覆盖的一个扇区
+typedef struct {
+    uint32_t addr;  // 扇区起始地址
+    uint32_t size;  // 扇区内被固件覆盖的长度,按页对齐
+    uint32_t crc;   // 该范围内固件数据的CRC32
+    bool skip;      // 目标芯片上内容已一致,无需擦除和编程
+} programmer_sector_t;
+
+static wl_handle_t s_wl_handle = WL_INVALID_HANDLE;
+static TaskHandle_t s_programmer_task = NULL;
+static portMUX_TYPE s_status_lock = portMUX_INITIALIZER_UNLOCKED;
+static programmer_status_t s_status;
+
+// 待执行任务的文件名,空字符串表示自动选择
+static char s_job_algorithm[CONFIG_PROGRAMMER_FILE_MAX_LEN];
+static char s_job_program[CONFIG_PROGRAMMER_FILE_MAX_LEN];
+
+// 更新烧录进度
+static void programmer_set_progress(uint32_t programmed)
+{
+    portENTER_CRITICAL(&s_status_lock);
+    s_status.programmed = MIN(programmed, s_status.total);
+    portEXIT_CRITICAL(&s_status_lock);
+}
+
+// 在目录中查找第一个普通文件
+static esp_err_t programmer_find_first(const char *root, char *name, size_t len)
+{
+    char path[CONFIG_PROGRAMMER_FILE_MAX_LEN];
+    struct dirent *entry;
+    struct stat st;
+    DIR *dir = opendir(root);
+
+    if (dir == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            strlcpy(name, entry->d_name, len);
+            closedir(dir);
+            return ESP_OK;
+        }
+    }
+
+    closedir(dir);
+    return ESP_ERR_NOT_FOUND;
+}
+
+// 读取一页固件数据,不足部分用擦除值填充
+static uint32_t programmer_read_page(FILE *fp, uint8_t *buf, uint32_t size, uint8_t erased_value)
+{
+    uint32_t n = fread(buf, 1, size, fp);
+
+    if (n < size) {
+        memset(buf + n, erased_value, size - n);
+    }
+    return n;
+}
+
+// 扫描固件,得到覆盖的扇区及各扇区内固件数据的CRC32
+static dap_err_t programmer_scan_image(const flash_algo_t *algo, FILE *fp, uint8_t *page, uint32_t image_size,
+                                       programmer_sector_t **sectors, uint32_t *count)
+{
+    uint32_t end = algo->flash_start + PROGRAMMER_ALIGN_UP(image_size, algo->page_size);
+    uint32_t addr, sector, sector_size, n, i;
+    programmer_sector_t *table;
+
+    // 先统计扇区数量
+    *count = 0;
+    for (addr = algo->flash_start; addr < end; addr = sector + sector_size) {
+        sector = flash_algo_sector(algo, addr, &sector_size);
+        if (sector_size == 0) {
+            return ERROR_IMAGE_BOUNDS;
+        }
+        (*count)++;
+    }
+
+    table = calloc(*count, sizeof(programmer_sector_t));
+    if (table == NULL) {
+        return ERROR_INTERNAL;
+    }
+
+    rewind(fp);
+    addr = algo->flash_start;
+    for (i = 0; i < *count; i++) {
+        sector = flash_algo_sector(algo, addr, &sector_size);
+        table[i].addr = sector;
+        table[i].size = MIN(sector + sector_size, end) - sector;
+
+        // 与编程时一致,固件末尾用擦除值填充到页边界
+        for (n = 0; n < table[i].size; n += algo->page_size) {
+            uint32_t len = MIN(algo->page_size, table[i].size - n);
+
+            programmer_read_page(fp, page, len, algo->erased_value);
+            table[i].crc = esp_rom_crc32_le(table[i].crc, page, len);
+        }
+        addr = sector + sector_size;
+    }
+
+    *sectors = table;
+    return ERROR_SUCCESS;
+}
+
+#if CONFIG_PROGRAMMER_BLANK_CHECK
+// 在目标芯片上检查整个扇区是否已是擦除状态,无法检查时按非空处理
+static bool programmer_sector_blank(const flash_algo_t *algo, uint32_t addr)
+{
+    uint32_t sector_size;
+    uint8_t blank = 0;
+
+    flash_algo_sector(algo, addr, &sector_size);
+    if (sector_size == 0 || (sector_size & 3) != 0) {
+        return false;
+    }
+
+    if (target_flash_blank_check(algo, addr, sector_size, &blank) != ERROR_SUCCESS) {
+        return false;
+    }
+    return blank;
+}
+#endif
+
+// 擦除固件覆盖的扇区,跳过无需改动或已是空白的扇区
+static dap_err_t programmer_erase(const flash_algo_t *algo, const programmer_sector_t *sectors, uint32_t count)
+{
+    dap_err_t ret;
+    uint32_t i;
+
+    ret = target_flash_func_init(algo, TARGET_FLASH_FUNC_ERASE);
+    if (ret != ERROR_SUCCESS) {
+        return ret;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (sectors[i].skip) {
+            continue;
+        }
+
+#if CONFIG_PROGRAMMER_BLANK_CHECK
+        if (programmer_sector_blank(algo, sectors[i].addr)) {
+            continue;
+        }
+#endif
+
+        ret = target_flash_erase_sector(algo, sectors[i].addr);
+        if (ret != ERROR_SUCCESS) {
+            return ret;
+        }
+    }
+
+    return target_flash_func_uninit(algo, TARGET_FLASH_FUNC_ERASE);
+}
+
+#if CONFIG_PROGRAMMER_INCREMENTAL
+// 增量烧录:在目标芯片上计算各扇区CRC32,与固件一致的扇区标记为跳过
+static dap_err_t programmer_compare(const flash_algo_t *algo, programmer_sector_t *sectors, uint32_t count)
+{
+    uint32_t crc, i, skipped = 0;
+    dap_err_t ret;
+
+    if (algo->crc32 == 0 || (algo->page_size & 3) != 0) {
+        return ERROR_SUCCESS;
+    }
+
+    for (i = 0; i < count; i++) {
+        ret = target_flash_crc32(algo, sectors[i].addr, sectors[i].size, &crc);
+        if (ret != ERROR_SUCCESS) {
+            return ret;
+        }
+        sectors[i].skip = (crc == sectors[i].crc);
+        skipped += sectors[i].skip;
+    }
+
+    ESP_LOGI(TAG, "增量烧录: %" PRIu32 "/%" PRIu32 " 个扇区无变化", skipped, count);
+    return ERROR_SUCCESS;
+}
+#endif
+
+// 逐页编程需要改动的扇区,目标芯片写入当前页时上传下一页
+static dap_err_t programmer_program(const flash_algo_t *algo, FILE *fp, uint8_t *page,
+                                    const programmer_sector_t *sectors, uint32_t count)
+{
+    target_flash_pipe_t pipe;
+    uint32_t done = 0;
+    uint32_t offset, i;
+    dap_err_t ret;
+
+    ret = target_flash_func_init(algo, TARGET_FLASH_FUNC_PROGRAM);
+    if (ret != ERROR_SUCCESS) {
+        return ret;
+    }
+
+    target_flash_pipe_init(&pipe, algo);
+
+    for (i = 0; i < count; i++) {
+        if (!sectors[i].skip) {
+            fseek(fp, sectors[i].addr - algo->flash_start, SEEK_SET);
+
+            for (offset = 0; offset < sectors[i].size; offset += algo->page_size) {
+                uint32_t len = MIN(algo->page_size, sectors[i].size - offset);
+
+                programmer_read_page(fp, page, len, algo->erased_value);
+
+                ret = target_flash_pipe_program(&pipe, sectors[i].addr + offset, page, len);
+                if (ret != ERROR_SUCCESS) {
+                    return ret;
+                }
+                programmer_set_progress(done + offset + len);
+            }
+        }
+
+        done += sectors[i].size;
+        programmer_set_progress(done);
+    }
+
+    ret = target_flash_pipe_flush(&pipe);
+    if (ret != ERROR_SUCCESS) {
+        return ret;
+    }
+
+    return target_flash_func_uninit(algo, TARGET_FLASH_FUNC_PROGRAM);
+}
+
+// 校验:优先在目标芯片上按扇区计算CRC32,否则使用算法的Verify或回读比较
+static dap_err_t programmer_verify(const flash_algo_t *algo, FILE *fp, uint8_t *page, uint32_t image_size,
+                                   const programmer_sector_t *sectors, uint32_t count)
+{
+    uint32_t offset, n, i;
+    dap_err_t ret;
+
+    ret = target_flash_func_init(algo, TARGET_FLASH_FUNC_VERIFY);
+    if (ret != ERROR_SUCCESS) {
+        return ret;
+    }
+
+    if (algo->crc32 != 0 && (algo->page_size & 3) == 0) {
+        for (i = 0; i < count; i++) {
+            if (sectors[i].skip) {
+                continue;
+            }
+
+            ret = target_flash_verify_crc32(algo, sectors[i].addr, sectors[i].size, sectors[i].crc);
+            if (ret != ERROR_SUCCESS) {
+                return ret;
+            }
+        }
+    } else {
+        rewind(fp);
+        for (offset = 0; offset < image_size; offset += algo->page_size) {
+            n = MIN(algo->page_size, image_size - offset);
+            programmer_read_page(fp, page, n, algo->erased_value);
+
+            ret = target_flash_verify(algo, algo->flash_start + offset, page, n);
+            if (ret != ERROR_SUCCESS) {
+                return ret;
+            }
+        }
+    }
+
+    return target_flash_func_uninit(algo, TARGET_FLASH_FUNC_VERIFY);
+}
+
+#if CONFIG_PROGRAMMER_SWD_BENCHMARK
+// 反复写入并读回目标RAM中的页缓冲区, 得到写/读每秒传输的字数
+static bool programmer_benchmark_run(const flash_algo_t *algo, uint8_t *page, uint32_t *write_rate, uint32_t *read_rate)
+{
+    uint32_t addr = algo->target.program_buffer;
+    uint32_t words = algo->page_size / 4 * CONFIG_PROGRAMMER_SWD_BENCHMARK_PAGES;
+    int64_t start, write_us, read_us;
+    uint32_t i;
+
+    for (i = 0; i < algo->page_size; i++) {
+        page[i] = (uint8_t)(i * 7 + 1);
+    }
+
+    start = esp_timer_get_time();
+    for (i = 0; i < CONFIG_PROGRAMMER_SWD_BENCHMARK_PAGES; i++) {
+        if (!swd_write_memory(addr, page, algo->page_size)) {
+            ESP_LOGW(TAG, "benchmark write failed");
+            return false;
+        }
+    }
+    write_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (i = 0; i < CONFIG_PROGRAMMER_SWD_BENCHMARK_PAGES; i++) {
+        if (!swd_read_memory(addr, page, algo->page_size)) {
+            ESP_LOGW(TAG, "benchmark read failed");
+            return false;
+        }
+    }
+    read_us = esp_timer_get_time() - start;
+
+    for (i = 0; i < algo->page_size; i++) {
+        if (page[i] != (uint8_t)(i * 7 + 1)) {
+            ESP_LOGW(TAG, "benchmark read back mismatch at 0x%08" PRIx32, addr + i);
+            return false;
+        }
+    }
+
+    *write_rate = (uint32_t)((uint64_t)words * 1000000 / MAX(write_us, 1));
+    *read_rate = (uint32_t)((uint64_t)words * 1000000 / MAX(read_us, 1));
+    return true;
+}
+
+// 测量SWD块传输速度: 先按逐字传输(改为突发传输之前的方式), 再按突发传输, 打印两者对比
+// 页缓冲区稍后会被ProgramPage的数据覆盖, 测试不影响烧录
+static void programmer_benchmark(const flash_algo_t *algo, uint8_t *page)
+{
+    uint32_t word_write, word_read, burst_write, burst_read;
+    bool ok;
+
+    swd_set_block_per_word(1);
+    ok = programmer_benchmark_run(algo, page, &word_write, &word_read);
+    swd_set_block_per_word(0);
+
+    if (ok && programmer_benchmark_run(algo, page, &burst_write, &burst_read)) {
+        ESP_LOGI(TAG, "SWD %" PRIu32 " Hz, %" PRIu32 " words each way", swd_get_clock(),
+                 algo->page_size / 4 * CONFIG_PROGRAMMER_SWD_BENCHMARK_PAGES);
+        ESP_LOGI(TAG, "per word: write %" PRIu32 " words/s, read %" PRIu32 " words/s", word_write, word_read);
+        ESP_LOGI(TAG, "burst:    write %" PRIu32 " words/s, read %" PRIu32 " words/s", burst_write, burst_read);
+    }
+}
+#endif
+
+// 执行一次完整的脱机烧录
+static dap_err_t programmer_run(const char *algorithm_path, const char *program_path)
+{
+    flash_algo_t algo;
+    struct stat st;
+    programmer_sector_t *sectors = NULL;
+    uint32_t sector_count = 0;
+    uint8_t *page = NULL;
+    FILE *fp = NULL;
+    dap_err_t ret, uninit_ret;
+
+    ret = flash_algo_load(algorithm_path, CONFIG_PROGRAMMER_TARGET_RAM_START,
+                          CONFIG_PROGRAMMER_TARGET_RAM_SIZE, &algo);
+    if (ret != ERROR_SUCCESS) {
+        return ret;
+    }
+
+    if (stat(program_path, &st) != 0 || (fp = fopen(program_path, "rb")) == NULL) {
+        ret = ERROR_IMAGE_FILE;
+        goto cleanup;
+    }
+
+    if (st.st_size == 0 || st.st_size > algo.flash_size) {
+        ret = ERROR_IMAGE_BOUNDS;
+        goto cleanup;
+    }
+
+    portENTER_CRITICAL(&s_status_lock);
+    s_status.total = st.st_size;
+    portEXIT_CRITICAL(&s_status_lock);
+
+    page = malloc(algo.page_size);
+    if (page == NULL) {
+        ret = ERROR_INTERNAL;
+        goto cleanup;
+    }
+
+    ret = programmer_scan_image(&algo, fp, page, st.st_size, &sectors, &sector_count);
+    if (ret != ERROR_SUCCESS) {
+        goto cleanup;
+    }
+
+    // 每次任务重新探测, 换上的目标板可能不同
+#if CONFIG_PROGRAMMER_SWD_CLOCK_PROBE
+    swd_set_clock(CONFIG_PROGRAMMER_SWD_CLOCK, 1);
+#else
+    swd_set_clock(CONFIG_PROGRAMMER_SWD_CLOCK, 0);
+#endif
+
+    ret = target_flash_init(&algo);
+    if (ret != ERROR_SUCCESS) {
+        goto cleanup;
+    }
+    ESP_LOGI(TAG, "SWCLK %" PRIu32 " Hz", swd_get_clock());
+#if CONFIG_PROGRAMMER_SWD_BENCHMARK
+    programmer_benchmark(&algo, page);
+#endif
+
+#if CONFIG_PROGRAMMER_INCREMENTAL
+    ret = programmer_compare(&algo, sectors, sector_count);
+    if (ret == ERROR_SUCCESS) {
+        ret = programmer_erase(&algo, sectors, sector_count);
+    }
+#else
+    ret = programmer_erase(&algo, sectors, sector_count);
+#endif
+    if (ret == ERROR_SUCCESS) {
+        ret = programmer_program(&algo, fp, page, sectors, sector_count);
+    }
+    if (ret == ERROR_SUCCESS) {
+        ret = programmer_verify(&algo, fp, page, st.st_size, sectors, sector_count);
+    }
+
+    // 无论成功与否都释放目标芯片
+    uninit_ret = target_flash_uninit();
+    if (ret == ERROR_SUCCESS) {
+        ret = uninit_ret;
+    }
+
+cleanup:
+    // 恢复调试主机设置的SWJ_Clock
+    swd_set_clock(0, 0);
+    free(sectors);
+    free(page);
+    if (fp) {
+        fclose(fp);
+    }
+    flash_algo_free(&algo);
+    return ret;
+}
+
+// 准备文件路径并执行烧录,更新状态
+static void programmer_execute(void)
+{
+    char algorithm_path[CONFIG_PROGRAMMER_FILE_MAX_LEN];
+    char program_path[CONFIG_PROGRAMMER_FILE_MAX_LEN];
+    programmer_status_t status = {0};
+    int64_t start = esp_timer_get_time();
+    dap_err_t ret = ERROR_SUCCESS;
+    bool owned;
+
+    portENTER_CRITICAL(&s_status_lock);
+    strlcpy(status.algorithm, s_job_algorithm, sizeof(status.algorithm));
+    strlcpy(status.program, s_job_program, sizeof(status.program));
+    portEXIT_CRITICAL(&s_status_lock);
+
+    if (status.algorithm[0] == '\0' &&
+        programmer_find_first(CONFIG_PROGRAMMER_ALGORITHM_ROOT, status.algorithm, sizeof(status.algorithm)) != ESP_OK) {
+        ret = ERROR_ALGO_FILE;
+    }
+    if (status.program[0] == '\0' &&
+        programmer_find_first(CONFIG_PROGRAMMER_PROGRAM_ROOT, status.program, sizeof(status.program)) != ESP_OK) {
+        ret = ERROR_IMAGE_FILE;
+    }
+    // 调试器会话占用目标芯片时不能烧录
+    if (kState != ACCEPTING) {
+        ret = ERROR_TARGET_BUSY;
+    }
+    // 整个烧录过程独占SWD, 期间DAP线程拒绝调试命令
+    if (ret == ERROR_SUCCESS && !dap_swd_take(PROGRAMMER_SWD_WAIT_MS)) {
+        ret = ERROR_TARGET_BUSY;
+    }
+    owned = (ret == ERROR_SUCCESS);
+
+    status.state = PROGRAMMER_RUNNING;
+    portENTER_CRITICAL(&s_status_lock);
+    s_status = status;
+    portEXIT_CRITICAL(&s_status_lock);
+
+    if (ret == ERROR_SUCCESS) {
+        snprintf(algorithm_path, sizeof(algorithm_path), "%s/%s", CONFIG_PROGRAMMER_ALGORITHM_ROOT, status.algorithm);
+        snprintf(program_path, sizeof(program_path), "%s/%s", CONFIG_PROGRAMMER_PROGRAM_ROOT, status.program);
+        ESP_LOGI(TAG, "开始烧录: %s -> %s", program_path, algorithm_path);
+        ret = programmer_run(algorithm_path, program_path);
+    }
+    if (owned) {
+        dap_swd_give();
+    }
+
+    portENTER_CRITICAL(&s_status_lock);
+    s_status.state = (ret == ERROR_SUCCESS) ? PROGRAMMER_DONE : PROGRAMMER_FAILED;
+    s_status.error = ret;
+    s_status.elapsed_ms = (esp_timer_get_time() - start) / 1000;
+    status = s_status;
+    portEXIT_CRITICAL(&s_status_lock);
+
+    if (ret == ERROR_SUCCESS) {
+        ESP_LOGI(TAG, "烧录完成, %" PRIu32 " 字节, 耗时 %" PRIu32 " ms", status.total, status.elapsed_ms);
+    } else {
+        ESP_LOGE(TAG, "烧录失败: %s", error_get_string(ret));
+    }
+}
+
+// 脱机烧录任务,等待触发按键或programmer_start()通知
+static void programmer_task(void *pvParameters)
+{
+    int last_level = 1;
+    int level;
+
+    while (1) {
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(50))) {
+            programmer_execute();
+            continue;
+        }
+
+#if (CONFIG_PROGRAMMER_TRIGGER_GPIO >= 0)
+        // 按键按下(下降沿)时使用默认文件烧录
+        level = gpio_get_level(CONFIG_PROGRAMMER_TRIGGER_GPIO);
+        if (level == 0 && last_level == 1) {
+            programmer_start(NULL, NULL);
+        }
+        last_level = level;
+#else
+        (void)level;
+        (void)last_level;
+#endif
+    }
+}
+
+// 文件名只能指向根目录下的文件: 不含路径分隔符和"..", 长度不会被截断
+static bool programmer_name_valid(const char *name)
+{
+    if (name == NULL) {
+        return true;
+    }
+    return strchr(name, '/') == NULL && strchr(name, '\\') == NULL && strstr(name, "..") == NULL &&
+           strlen(name) < CONFIG_PROGRAMMER_FILE_MAX_LEN;
+}
+
+esp_err_t programmer_start(const char *algorithm, const char *program)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (s_programmer_task == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!programmer_name_valid(algorithm) || !programmer_name_valid(program)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_status_lock);
+    if (s_status.state == PROGRAMMER_RUNNING) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        strlcpy(s_job_algorithm, algorithm ? algorithm : "", sizeof(s_job_algorithm));
+        strlcpy(s_job_program, program ? program : "", sizeof(s_job_program));
+        s_status.state = PROGRAMMER_RUNNING;
+    }
+    portEXIT_CRITICAL(&s_status_lock);
+
+    if (ret == ESP_OK) {
+        xTaskNotifyGive(s_programmer_task);
+    }
+    return ret;
+}
+
+void programmer_get_status(programmer_status_t *status)
+{
+    portENTER_CRITICAL(&s_status_lock);
+    *status = s_status;
+    portEXIT_CRITICAL(&s_status_lock);
+}
+
+esp_err_t programmer_init(void)
+{
+    const esp_vfs_fat_mount_config_t mount_config = {
+        .max_files = 4,
+#ifdef CONFIG_PROGRAMMER_FORMAT_IF_MOUNT_FAILED
+        .format_if_mount_failed = true,
+#else
+        .format_if_mount_failed = false,   // 挂载失败只报告, 不清除已上传的文件
+#endif
+        .allocation_unit_size = CONFIG_WL_SECTOR_SIZE,
+    };
+
+    ESP_LOGI(TAG, "挂载 %s 分区到 %s", CONFIG_PROGRAMMER_PARTITION_LABEL, CONFIG_PROGRAMMER_MOUNT_POINT);
+    esp_err_t ret = esp_vfs_fat_spiflash_mount_rw_wl(CONFIG_PROGRAMMER_MOUNT_POINT, CONFIG_PROGRAMMER_PARTITION_LABEL,
+                                                     &mount_config, &s_wl_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "挂载FAT分区失败 (%s)", esp_err_to_name(ret));
+        return ret;
+    }
+
+    // 确保算法和固件目录存在
+    if (mkdir(CONFIG_PROGRAMMER_ALGORITHM_ROOT, 0775) != 0 && errno != EEXIST) {
+        ESP_LOGW(TAG, "无法创建目录 %s", CONFIG_PROGRAMMER_ALGORITHM_ROOT);
+    }
+    if (mkdir(CONFIG_PROGRAMMER_PROGRAM_ROOT, 0775) != 0 && errno != EEXIST) {
+        ESP_LOGW(TAG, "无法创建目录 %s", CONFIG_PROGRAMMER_PROGRAM_ROOT);
+    }
+
+#if (CONFIG_PROGRAMMER_TRIGGER_GPIO >= 0)
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << CONFIG_PROGRAMMER_TRIGGER_GPIO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    gpio_config(&io_conf);
+#endif
+
+    // 与DAP线程相同, 在远离WiFi中断的核上产生SWD时序
+    if (xTaskCreatePinnedToCore(programmer_task, "programmer", 4096, NULL, 5, &s_programmer_task,
+                                CONFIG_DAP_TASK_CORE) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,40 @@
+/*
+ * @Description: 脱机烧录引擎头文件,从storage分区读取算法和固件,无需PC即可完成烧录
+ */
+
+#ifndef _PROGRAMMER_H_
+#define _PROGRAMMER_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "components/DAP/Include/error.h"
+
+typedef enum {
+    PROGRAMMER_IDLE = 0,   // 空闲
+    PROGRAMMER_RUNNING,    // 正在烧录
+    PROGRAMMER_DONE,       // 上一次烧录成功
+    PROGRAMMER_FAILED,     // 上一次烧录失败
+} programmer_state_t;
+
+typedef struct {
+    programmer_state_t state;
+    dap_err_t error;                                   // 失败原因
+    uint32_t total;                                    // 固件总字节数
+    uint32_t programmed;                               // 已烧录字节数
+    uint32_t elapsed_ms;                               // 本次烧录耗时
+    char algorithm[CONFIG_PROGRAMMER_FILE_MAX_LEN];    // 使用的算法文件
+    char program[CONFIG_PROGRAMMER_FILE_MAX_LEN];      // 使用的固件文件
+} programmer_status_t;
+
+// 挂载storage分区并启动脱机烧录任务
+esp_err_t programmer_init(void);
+
+// 启动一次烧录,文件名为NULL时使用对应目录中的第一个文件
+// 文件名含'/'、'\'或".."时返回ESP_ERR_INVALID_ARG, 烧录进行中返回ESP_ERR_INVALID_STATE
+esp_err_t programmer_start(const char *algorithm, const char *program);
+
+// 获取当前烧录状态
+void programmer_get_status(programmer_status_t *status);
+
+#endif /* _PROGRAMMER_H_ */
@@ -17,6 +17,7 @@
 #include <sys/stat.h>
 #include "nvs_flash.h"
 #include "lwip/ip4_addr.h"
+#include "programmer.h"
 
 static const char *TAG = "http_server";
 static httpd_handle_t server = NULL;
@@ -31,6 +32,8 @@ static esp_err_t saved_wifi_get_handler(httpd_req_t *req);
 static esp_err_t delete_wifi_post_handler(httpd_req_t *req);
 static esp_err_t get_status_handler(httpd_req_t *req);
 static esp_err_t wechat_delete_wifi_handler(httpd_req_t *req);
+static esp_err_t program_post_handler(httpd_req_t *req);
+static esp_err_t program_status_get_handler(httpd_req_t *req);
 static bool is_wifi_config_exists(const char* ssid, const char* password);
 
 // 处理根路径请求 - 返回index.html
@@ -589,6 +592,92 @@ static esp_err_t get_status_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+// 启动脱机烧录,可选指定算法和固件文件名
+static esp_err_t program_post_handler(httpd_req_t *req)
+{
+    char buf[2 * CONFIG_PROGRAMMER_FILE_MAX_LEN + 64];
+    const char *algorithm = NULL;
+    const char *program = NULL;
+    cJSON *root = NULL;
+    int ret = 0;
+
+    if (req->content_len >= sizeof(buf)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Request too long");
+        return ESP_FAIL;
+    }
+
+    if (req->content_len > 0) {
+        ret = httpd_req_recv(req, buf, req->content_len);
+        if (ret <= 0) {
+            return ESP_FAIL;
+        }
+        buf[ret] = '\0';
+
+        root = cJSON_Parse(buf);
+        if (!root) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+            return ESP_FAIL;
+        }
+
+        cJSON *item = cJSON_GetObjectItem(root, "algorithm");
+        if (cJSON_IsString(item)) {
+            algorithm = item->valuestring;
+        }
+        item = cJSON_GetObjectItem(root, "program");
+        if (cJSON_IsString(item)) {
+            program = item->valuestring;
+        }
+    }
+
+    esp_err_t err = programmer_start(algorithm, program);
+    cJSON_Delete(root);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_sendstr(req, "{\"status\":\"invalid file name\"}");
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_sendstr(req, "{\"status\":\"busy\"}");
+        return ESP_OK;
+    }
+    httpd_resp_sendstr(req, "{\"status\":\"ok\"}");
+    return ESP_OK;
+}
+
+// 获取脱机烧录状态
+static esp_err_t program_status_get_handler(httpd_req_t *req)
+{
+    static const char *state_str[] = {"idle", "running", "done", "failed"};
+    programmer_status_t status;
+    char *response = NULL;
+    cJSON *root = cJSON_CreateObject();
+
+    programmer_get_status(&status);
+
+    cJSON_AddStringToObject(root, "state", state_str[status.state]);
+    cJSON_AddStringToObject(root, "algorithm", status.algorithm);
+    cJSON_AddStringToObject(root, "program", status.program);
+    cJSON_AddNumberToObject(root, "total", status.total);
+    cJSON_AddNumberToObject(root, "programmed", status.programmed);
+    cJSON_AddNumberToObject(root, "elapsed_ms", status.elapsed_ms);
+    if (status.state == PROGRAMMER_FAILED) {
+        cJSON_AddStringToObject(root, "error", error_get_string(status.error));
+    }
+
+    response = cJSON_PrintUnformatted(root);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_sendstr(req, response);
+
+    free(response);
+    cJSON_Delete(root);
+    return ESP_OK;
+}
+
 // 检查WiFi配置是否已存在
 static bool is_wifi_config_exists(const char* ssid, const char* password) {
     wifi_config_t saved_config = {0};
@@ -694,6 +783,20 @@ static const httpd_uri_t wechat_delete = {
     .user_ctx  = NULL
 };
 
+static const httpd_uri_t program = {
+    .uri       = "/api/program",
+    .method    = HTTP_POST,
+    .handler   = program_post_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t program_status = {
+    .uri       = "/api/program/status",
+    .method    = HTTP_GET,
+    .handler   = program_status_get_handler,
+    .user_ctx  = NULL
+};
+
 // 启动Web服务器
 esp_err_t start_webserver(void)
 {
@@ -726,6 +829,8 @@ esp_err_t start_webserver(void)
         httpd_register_uri_handler(server, &get_status);  // 获取状态路径
         httpd_register_uri_handler(server, &wechat_delete);  // 微信小程序删除WiFi路径
         httpd_register_uri_handler(server, &ip_info_uri);
+        httpd_register_uri_handler(server, &program);         // 启动脱机烧录
+        httpd_register_uri_handler(server, &program_status);  // 脱机烧录状态
         return ESP_OK;
     }
     
@@ -39,9 +39,14 @@ static struct {
 #define DAP_IP_NETMASK 255, 255, 255, 0    // 子网掩码
 
 #define PORT                3240  // 服务端口号
+#define MAX_CLIENTS         4     // 同时保持的连接数,其中一个拥有DAP,其余等待
 #define CONFIG_EXAMPLE_IPV4 1     // 使用IPv4
 #define MTU_SIZE            1500  // 最大传输单元大小
 
+/* 传输方式 */
+#define USE_KCP             0     // 1: 使用基于UDP的KCP可靠传输(同一端口), 需主机端KCP转发; 0: 使用TCP
+#define USE_TCP_NETCONN     0     // 1: TCP使用lwIP netconn接口, 省去socket层的拷贝; 0: 使用BSD socket
+
 
 
 /* printf函数声明和包装 */